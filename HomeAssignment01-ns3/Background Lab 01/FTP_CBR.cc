@@ -29,6 +29,12 @@
 #include "ns3/ipv4-global-routing-helper.h"
 #include "ns3/traffic-control-module.h"
 #include "ns3/flow-monitor-module.h"
+#include "flow-sampler.h"
+#include "flow-results.h"
+#include "latency-histogram.h"
+#include "queue-trace.h"
+#include "tcp-trace.h"
+#include "pcap-replay.h"
 
 
 using namespace ns3;
@@ -45,26 +51,76 @@ bool first_drop=true;
 double endTime = 5.0;
 double startTimeCBR = 0.0, endTimeCBR   = 5.0;
 double startTimeFTP = 0.0, endTimeFTP   = 5.0;
+
+// Count the packets dropped at the n0-n1 link, by the device queue or the queue disc in front of it
+void
+CountDrop ()
+{
+    if (first_drop)
+    {
+        first_drop = false;
+        std::cout << "First packet drop at " << Simulator::Now ().GetSeconds () << " s" << std::endl;
+    }
+    total_drops++;
+}
+
+void
+DeviceQueueDrop (Ptr<const Packet> packet)
+{
+    CountDrop ();
+}
+
+void
+QueueDiscDrop (Ptr<const QueueDiscItem> item)
+{
+    CountDrop ();
+}
     
 int
 main (int argc, char *argv[])
 {
 
     bool tracing = false;
+    std::string resultsFile = "data.flowres";
+    bool resultsHistograms = false;
+    bool flowmonXml = false;
     uint32_t maxBytes = 0;
     std::string prot = "TcpWestwood";
+    double sampleInterval = 0; // seconds, 0 disables the time-series output
+    std::string sampleFile = "ftp-cbr-samples.csv";
+    std::string queueTrace = "";  // binary queue depth/drop trace, empty disables it
+    double queueInterval = 0.001; // seconds
+    std::string tcpTrace = "";    // binary cwnd/RTT trace of the FTP sender, empty disables it
+    uint32_t tcpDecimation = 1;
+    std::string replay = "";      // capture whose packet sizes and timing replace the CBR source
+    double replayScale = 1.0;
+    uint32_t replayPort = 0;
 //    double error = 0.000001;
 
     // Allow the user to override any of the defaults at
     // run-time, via command-line arguments
-/*    CommandLine cmd;
+    CommandLine cmd;
     cmd.AddValue ("tracing", "Flag to enable/disable tracing", tracing);
-    cmd.AddValue ("maxBytes",
+/*    cmd.AddValue ("maxBytes",
                   "Total number of bytes for application to send", maxBytes);
     cmd.AddValue ("error", "Packet error rate", error);
-
-    cmd.Parse (argc, argv);
 */
+    cmd.AddValue ("sampleInterval", "Per-flow statistics sampling interval in seconds (0 = off)", sampleInterval);
+    cmd.AddValue ("sampleFile", "CSV file for the per-flow time series", sampleFile);
+    cmd.AddValue ("endTime", "Simulated time in seconds", endTime);
+    cmd.AddValue ("queueTrace", "Binary queue depth and drop trace of the n0-n1 link (see queue-trace.h)", queueTrace);
+    cmd.AddValue ("queueInterval", "Queue depth sampling interval in seconds", queueInterval);
+    cmd.AddValue ("tcpTrace", "Binary cwnd/ssthresh/RTT/bandwidth trace of the FTP sender (see tcp-trace.h)", tcpTrace);
+    cmd.AddValue ("tcpDecimation", "Keep only every n-th change of each traced TCP variable", tcpDecimation);
+    cmd.AddValue ("replay", "pcap/pcapng capture to replay in place of the CBR flow (see pcap-replay.h)", replay);
+    cmd.AddValue ("replayScale", "Factor applied to the inter-arrival times of the replayed capture", replayScale);
+    cmd.AddValue ("replayPort", "Only replay capture records with this port (0 = all)", replayPort);
+    cmd.AddValue ("resultsFile", "Binary per-flow results (see flow_results.py)", resultsFile);
+    cmd.AddValue ("resultsHistograms", "Add delay/jitter/packet size histograms to the results", resultsHistograms);
+    cmd.AddValue ("flowmonXml", "Also write the full FlowMonitor XML to data.flowmon", flowmonXml);
+    cmd.Parse (argc, argv);
+    endTimeCBR = endTimeFTP = endTime;
+
     Config::SetDefault ("ns3::TcpL4Protocol::SocketType", TypeIdValue (TcpWestwood::GetTypeId ()));
     Config::SetDefault ("ns3::TcpWestwood::ProtocolType", EnumValue (TcpWestwood::WESTWOODPLUS));
     Config::SetDefault ("ns3::TcpWestwood::FilterType", EnumValue (TcpWestwood::TUSTIN));
@@ -107,6 +163,19 @@ main (int argc, char *argv[])
     Ipv4AddressHelper ipv4;
     ipv4.SetBase ("10.1.1.0", "255.255.255.0");
     Ipv4InterfaceContainer i0i1 = ipv4.Assign (d0d1);
+
+    // Drops of the bottleneck queues (the queue disc is installed by Assign above)
+    Ptr<TrafficControlLayer> tc = nodes.Get (0)->GetObject<TrafficControlLayer> ();
+    DynamicCast<PointToPointNetDevice> (d0d1.Get (0))->GetQueue ()->TraceConnectWithoutContext ("Drop", MakeCallback (&DeviceQueueDrop));
+    tc->GetRootQueueDiscOnDevice (d0d1.Get (0))->TraceConnectWithoutContext ("Drop", MakeCallback (&QueueDiscDrop));
+    QueueTracer *queueTracer = 0;
+    if (!queueTrace.empty ())
+    {
+        queueTracer = new QueueTracer (queueTrace, Seconds (queueInterval));
+        queueTracer->Add (DynamicCast<PointToPointNetDevice> (d0d1.Get (0)));
+        queueTracer->Add (DynamicCast<PointToPointNetDevice> (d0d1.Get (1)));
+        queueTracer->Start (Seconds (0));
+    }
      
     
     // Create router nodes, initialize routing database and set up the routing
@@ -123,7 +192,22 @@ main (int argc, char *argv[])
         std::string CBRdataRate= "448Kbps";
         onOff.SetConstantRate (DataRate (CBRdataRate));
       
-       ApplicationContainer apps = onOff.Install (nodes.Get (0));
+       ApplicationContainer apps;
+       if (replay.empty ())
+       {
+           apps = onOff.Install (nodes.Get (0));
+       }
+       else
+       {
+           // Real traffic instead: packet sizes and gaps of a capture, to the same sink
+           PcapReplayHelper replayHelper ("ns3::UdpSocketFactory", InetSocketAddress (i0i1.GetAddress (1), cbrPort), replay);
+           replayHelper.SetAttribute ("TimeScale", DoubleValue (replayScale));
+           replayHelper.SetAttribute ("Port", UintegerValue (replayPort));
+           apps = replayHelper.Install (nodes.Get (0));
+       }
+       // Per-packet one-way delay of the CBR flow, for its tail latency next to the bulk transfer
+       LatencyRecorder latency;
+       latency.Watch (apps.Get (0), nodes.Get (1), "CBR");
        apps.Start (Seconds (startTimeCBR));
        apps.Stop (Seconds (endTimeCBR));
      
@@ -141,6 +225,13 @@ main (int argc, char *argv[])
         ApplicationContainer sourceApps = source.Install (nodes.Get (0));
         sourceApps.Start (Seconds (startTimeFTP));
         sourceApps.Stop (Seconds (endTimeFTP));
+        // Westwood+ congestion state of the FTP sender against the CBR flow
+        TcpTracer *tcpTracer = 0;
+        if (!tcpTrace.empty ())
+        {
+            tcpTracer = new TcpTracer (tcpTrace, tcpDecimation);
+            tcpTracer->Add (DynamicCast<BulkSendApplication> (sourceApps.Get (0)), Seconds (startTimeFTP));
+        }
         // Create a PacketSinkApplication and install it on node 1
         //Takes as an argument which port it should be connected to
         PacketSinkHelper sinkFTP ("ns3::TcpSocketFactory",InetSocketAddress (Ipv4Address::GetAny(), ftpSenderPort));
@@ -167,8 +258,17 @@ main (int argc, char *argv[])
     FlowMonitorHelper flowHelper;
     flowMonitor = flowHelper.InstallAll();
 
+    // Periodic per-flow throughput/delay/loss, e.g. to see TCP slow start next to the CBR flow
+    FlowSampler *sampler = 0;
+    if (sampleInterval > 0)
+    {
+        sampler = new FlowSampler (flowMonitor, Seconds (sampleInterval), sampleFile);
+        sampler->Start (Seconds (0));
+    }
+
     Simulator::Stop (Seconds (endTime));
     Simulator::Run ();
+    std::cout << "Events processed = " << Simulator::GetEventCount () << std::endl;
     
     Ptr<Ipv4FlowClassifier> classifier = DynamicCast<Ipv4FlowClassifier> (flowHelper.GetClassifier ());
     std::map<FlowId, FlowMonitor::FlowStats> stats = flowMonitor->GetFlowStats ();
@@ -193,9 +293,20 @@ main (int argc, char *argv[])
           std::cout << "  Mean jitter\t\t" << iter->second.jitterSum.GetSeconds () / (iter->second.rxPackets - 1) << std::endl;
     }
 
+    std::cout << std::endl;
+    latency.Report (std::cout);
+    std::cout << "Total drops at the n0-n1 link = " << total_drops << std::endl;
     std::cout << std::endl << std::endl ;
-    flowMonitor->SerializeToXmlFile("data.flowmon", true, true);
+    // One compact row per flow; the XML with histograms and probes only when asked for
+    FlowResultsWriter (flowMonitor, classifier, resultsHistograms).Write (resultsFile);
+    if (flowmonXml)
+    {
+        flowMonitor->SerializeToXmlFile("data.flowmon", true, true);
+    }
     Simulator::Destroy ();
+    delete sampler;
+    delete queueTracer;
+    delete tcpTracer;
     NS_LOG_INFO ("Done.");
 
 }
@@ -0,0 +1,240 @@
+ //
+ // Network topology (dumbbell, nPairs sender/receiver pairs)
+ //
+ //       s0 ---+                                 +--- r0
+ //       s1 ---+      bottleneckRate, 10ms       +--- r1
+ //       ...   L ------------------------------- R   ...
+ //       sN ---+                                 +--- rN
+ //          8Mbps, 10ms                    8Mbps, 10ms
+ //
+ // - all links are point-to-point links with indicated one-way BW/delay
+ // - every pair carries the FTP_CBR mix: a 448Kbps CBR flow and a
+ //   TCP Westwood+ bulk transfer from si to ri
+ // - DropTail queues
+ //
+ // The topology is split over the MPI ranks: router L is on rank 0, router R
+ // on rank 1 (when there is more than one rank). The routers forward every
+ // packet of every pair, so with more than two ranks the pairs go to the
+ // other ranks only (pair i on rank 2 + i % (ranks - 2)); with one or two
+ // ranks pair i is on rank i % ranks. Every link that crosses ranks is a
+ // point-to-point link with a 10ms delay, which is the lookahead of the
+ // distributed simulator. Each rank only runs the applications of its own
+ // nodes; the sink byte counts are summed on rank 0 at the end, and the
+ // events of every rank are printed so that load imbalance shows.
+ //
+ // ns-3 must be configured with --enable-mpi. Run on one machine with e.g.
+ //   mpirun -np 4 ./build/scratch/FTP_CBR_mpi --nPairs=256
+ // (add --nullmsg to use the null message synchronisation instead of the
+ // default barrier based one).
+
+
+// This code heavily borrows from ns3 itself which are copyright of their
+// respective authors and redistributable under the same conditions.
+
+#include <mpi.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include "ns3/core-module.h"
+#include "ns3/point-to-point-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/applications-module.h"
+#include "ns3/network-module.h"
+#include "ns3/packet-sink.h"
+#include "ns3/enum.h"
+#include "ns3/ipv4-global-routing-helper.h"
+#include "ns3/mpi-interface.h"
+
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("TcpComparisionMpi");
+
+double endTime = 5.0;
+double startTimeCBR = 0.0, endTimeCBR   = 5.0;
+double startTimeFTP = 0.0, endTimeFTP   = 5.0;
+
+// Rank that simulates pair i: keep the pairs off the router ranks when there are spare ones
+uint32_t
+PairRank (uint32_t i, uint32_t systemCount)
+{
+    return systemCount > 2 ? 2 + i % (systemCount - 2) : i % systemCount;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+
+    uint32_t nPairs = 16;
+    std::string bottleneckRate = "100Mbps";
+    bool nullmsg = false;
+
+    CommandLine cmd;
+    cmd.AddValue ("nPairs", "Number of sender/receiver pairs", nPairs);
+    cmd.AddValue ("bottleneckRate", "Data rate of the L-R link", bottleneckRate);
+    cmd.AddValue ("endTime", "Simulated time in seconds", endTime);
+    cmd.AddValue ("nullmsg", "Use the null message distributed simulator", nullmsg);
+    cmd.Parse (argc, argv);
+    endTimeCBR = endTimeFTP = endTime;
+
+    // The simulator implementation has to be chosen before MPI is enabled
+    if (nullmsg)
+    {
+        GlobalValue::Bind ("SimulatorImplementationType", StringValue ("ns3::NullMessageSimulatorImpl"));
+    }
+    else
+    {
+        GlobalValue::Bind ("SimulatorImplementationType", StringValue ("ns3::DistributedSimulatorImpl"));
+    }
+    MpiInterface::Enable (&argc, &argv);
+    uint32_t systemId = MpiInterface::GetSystemId ();
+    uint32_t systemCount = MpiInterface::GetSize ();
+    std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now ();
+
+    Config::SetDefault ("ns3::TcpL4Protocol::SocketType", TypeIdValue (TcpWestwood::GetTypeId ()));
+    Config::SetDefault ("ns3::TcpWestwood::ProtocolType", EnumValue (TcpWestwood::WESTWOODPLUS));
+    Config::SetDefault ("ns3::TcpWestwood::FilterType", EnumValue (TcpWestwood::TUSTIN));
+
+    Config::SetDefault ("ns3::QueueBase::MaxSize", QueueSizeValue (QueueSize (QueueSizeUnit::PACKETS, 20)));
+    int senderWindowSize = 8000;
+    Config::SetDefault ("ns3::TcpSocket::InitialCwnd", UintegerValue(senderWindowSize)); // was 8
+    Config::SetDefault ("ns3::TcpSocket::RcvBufSize", UintegerValue(senderWindowSize)); // was 65355
+
+    // Every rank creates every node; the system id says which rank simulates it
+    NS_LOG_INFO ("Create nodes.");
+    uint32_t rightRank = systemCount > 1 ? 1 : 0;
+    Ptr<Node> left = CreateObject<Node> (0);
+    Ptr<Node> right = CreateObject<Node> (rightRank);
+    NodeContainer senders, receivers;
+    for (uint32_t i = 0; i < nPairs; ++i)
+    {
+        senders.Add (CreateObject<Node> (PairRank (i, systemCount)));
+        receivers.Add (CreateObject<Node> (PairRank (i, systemCount)));
+    }
+
+    // Install the internet stack on the nodes
+    InternetStackHelper internet;
+    internet.Install (left);
+    internet.Install (right);
+    internet.Install (senders);
+    internet.Install (receivers);
+
+    NS_LOG_INFO ("Create channels.");
+
+    // Links between different ranks become remote channels
+    PointToPointHelper bottleneck;
+    bottleneck.SetDeviceAttribute ("DataRate", StringValue (bottleneckRate));
+    bottleneck.SetChannelAttribute ("Delay", StringValue ("10ms"));
+    bottleneck.SetQueue ("ns3::DropTailQueue");
+
+    PointToPointHelper access;
+    access.SetDeviceAttribute ("DataRate", StringValue ("8Mbps"));
+    access.SetChannelAttribute ("Delay", StringValue ("10ms"));
+    access.SetQueue ("ns3::DropTailQueue");
+
+    NS_LOG_INFO ("Assign IP Addresses.");
+    Ipv4AddressHelper ipv4;
+    ipv4.SetBase ("10.0.0.0", "255.255.255.252");
+    ipv4.Assign (bottleneck.Install (left, right));
+    std::vector<Ipv4Address> receiverAddress;
+    for (uint32_t i = 0; i < nPairs; ++i)
+    {
+        ipv4.NewNetwork ();
+        ipv4.Assign (access.Install (senders.Get (i), left));
+        ipv4.NewNetwork ();
+        Ipv4InterfaceContainer ri = ipv4.Assign (access.Install (receivers.Get (i), right));
+        receiverAddress.push_back (ri.GetAddress (0));
+    }
+
+    // Create router nodes, initialize routing database and set up the routing
+    // tables in the nodes.
+    Ipv4GlobalRoutingHelper::PopulateRoutingTables ();
+
+    NS_LOG_INFO ("Create Applications.");
+
+    // Only the pairs simulated by this rank get applications
+    uint16_t cbrPort = 12345;
+    uint16_t ftpSenderPort = 12344;
+    std::string CBRdataRate= "448Kbps";
+    uint32_t maxBytes = 20*1024*1024;
+    std::vector<Ptr<PacketSink> > cbrSinks, ftpSinks;
+    for (uint32_t i = 0; i < nPairs; ++i)
+    {
+        if (PairRank (i, systemCount) != systemId)
+        {
+            continue;
+        }
+        OnOffHelper onOff ("ns3::UdpSocketFactory", InetSocketAddress (receiverAddress[i], cbrPort));
+        onOff.SetConstantRate (DataRate (CBRdataRate));
+        ApplicationContainer apps = onOff.Install (senders.Get (i));
+        apps.Start (Seconds (startTimeCBR));
+        apps.Stop (Seconds (endTimeCBR));
+
+        PacketSinkHelper sinkCBR ("ns3::UdpSocketFactory",
+                                  Address (InetSocketAddress (Ipv4Address::GetAny (), cbrPort)));
+        apps = sinkCBR.Install (receivers.Get (i));
+        apps.Start (Seconds (startTimeCBR));
+        apps.Stop (Seconds (endTimeCBR));
+        cbrSinks.push_back (DynamicCast<PacketSink> (apps.Get (0)));
+
+        BulkSendHelper source ("ns3::TcpSocketFactory", InetSocketAddress (receiverAddress[i], ftpSenderPort));
+        // Set the amount of data to send in bytes.  Zero is unlimited.
+        source.SetAttribute ("MaxBytes", UintegerValue (maxBytes));
+        ApplicationContainer sourceApps = source.Install (senders.Get (i));
+        sourceApps.Start (Seconds (startTimeFTP));
+        sourceApps.Stop (Seconds (endTimeFTP));
+
+        PacketSinkHelper sinkFTP ("ns3::TcpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), ftpSenderPort));
+        ApplicationContainer sinkApps = sinkFTP.Install (receivers.Get (i));
+        sinkApps.Start (Seconds (startTimeFTP));
+        sinkApps.Stop (Seconds (endTimeFTP));
+        ftpSinks.push_back (DynamicCast<PacketSink> (sinkApps.Get (0)));
+    }
+
+    NS_LOG_INFO ("Run Simulation.");
+
+    Simulator::Stop (Seconds (endTime));
+    Simulator::Run ();
+
+    // Sum the per-rank results on rank 0
+    double local[3] = { 0, 0, static_cast<double> (Simulator::GetEventCount ()) };
+    for (size_t i = 0; i < cbrSinks.size (); ++i)
+    {
+        local[0] += cbrSinks[i]->GetTotalRx ();
+    }
+    for (size_t i = 0; i < ftpSinks.size (); ++i)
+    {
+        local[1] += ftpSinks[i]->GetTotalRx ();
+    }
+    double total[3] = { 0, 0, 0 };
+    MPI_Reduce (local, total, 3, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    double wall = std::chrono::duration<double> (std::chrono::steady_clock::now () - wallStart).count ();
+    double maxWall = 0;
+    MPI_Reduce (&wall, &maxWall, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    // The slowest rank sets the wall time, so show how the events were spread
+    std::vector<double> rankEvents (systemCount);
+    MPI_Gather (&local[2], 1, MPI_DOUBLE, &rankEvents[0], 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+    if (systemId == 0)
+    {
+        double cbrTput = total[0] * 8.0 / endTime / 1e6;
+        double ftpTput = total[1] * 8.0 / endTime / 1e6;
+        std::cout << nPairs << " pairs on " << systemCount << " ranks, " << maxWall << " s wall time" << std::endl;
+        std::cout << "Events processed = " << static_cast<uint64_t> (total[2]) << std::endl;
+        std::cout << "Events per rank =";
+        for (uint32_t r = 0; r < systemCount; ++r)
+        {
+            std::cout << " " << static_cast<uint64_t> (rankEvents[r]);
+        }
+        std::cout << std::endl;
+        std::cout << "Total channel throughput = " << cbrTput + ftpTput << "Mbps" << std::endl;
+        std::cout << "CBR throughput = " << cbrTput << "Mbps" << std::endl;
+        std::cout << "FTP throughput = " << ftpTput << "Mbps" << std::endl;
+    }
+
+    Simulator::Destroy ();
+    MpiInterface::Disable ();
+    NS_LOG_INFO ("Done.");
+
+}
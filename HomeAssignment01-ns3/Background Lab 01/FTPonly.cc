@@ -29,6 +29,7 @@
 #include "ns3/ipv4-global-routing-helper.h"
 #include "ns3/traffic-control-module.h"
 #include "ns3/flow-monitor-module.h"
+#include "flow-results.h"
 
 
 using namespace ns3;
@@ -51,20 +52,28 @@ main (int argc, char *argv[])
 {
 
     bool tracing = false;
+    std::string resultsFile = "data.flowres";
+    bool resultsHistograms = false;
+    bool flowmonXml = false;
     uint32_t maxBytes = 0;
     std::string prot = "TcpWestwood";
 //    double error = 0.000001;
 
     // Allow the user to override any of the defaults at
     // run-time, via command-line arguments
-/*    CommandLine cmd;
+    CommandLine cmd;
     cmd.AddValue ("tracing", "Flag to enable/disable tracing", tracing);
-    cmd.AddValue ("maxBytes",
+/*    cmd.AddValue ("maxBytes",
                   "Total number of bytes for application to send", maxBytes);
     cmd.AddValue ("error", "Packet error rate", error);
-
-    cmd.Parse (argc, argv);
 */
+    cmd.AddValue ("endTime", "Simulated time in seconds", endTime);
+    cmd.AddValue ("resultsFile", "Binary per-flow results (see flow_results.py)", resultsFile);
+    cmd.AddValue ("resultsHistograms", "Add delay/jitter/packet size histograms to the results", resultsHistograms);
+    cmd.AddValue ("flowmonXml", "Also write the full FlowMonitor XML to data.flowmon", flowmonXml);
+    cmd.Parse (argc, argv);
+    endTimeFTP = endTime;
+
     Config::SetDefault ("ns3::TcpL4Protocol::SocketType", TypeIdValue (TcpWestwood::GetTypeId ()));
     Config::SetDefault ("ns3::TcpWestwood::ProtocolType", EnumValue (TcpWestwood::WESTWOODPLUS));
     Config::SetDefault ("ns3::TcpWestwood::FilterType", EnumValue (TcpWestwood::TUSTIN));
@@ -152,6 +161,7 @@ main (int argc, char *argv[])
 
     Simulator::Stop (Seconds (endTime));
     Simulator::Run ();
+    std::cout << "Events processed = " << Simulator::GetEventCount () << std::endl;
     
     Ptr<Ipv4FlowClassifier> classifier = DynamicCast<Ipv4FlowClassifier> (flowHelper.GetClassifier ());
     std::map<FlowId, FlowMonitor::FlowStats> stats = flowMonitor->GetFlowStats ();
@@ -177,7 +187,12 @@ main (int argc, char *argv[])
     }
 
     std::cout << std::endl << std::endl ;
-    flowMonitor->SerializeToXmlFile("data.flowmon", true, true);
+    // One compact row per flow; the XML with histograms and probes only when asked for
+    FlowResultsWriter (flowMonitor, classifier, resultsHistograms).Write (resultsFile);
+    if (flowmonXml)
+    {
+        flowMonitor->SerializeToXmlFile("data.flowmon", true, true);
+    }
     Simulator::Destroy ();
     NS_LOG_INFO ("Done.");
 
@@ -23,7 +23,7 @@
  *
  * This example illustrates the use of
  *  - Wifi in ad-hoc mode
- *  - Matrix propagation loss model
+ *  - Group (collision domain) propagation loss model
  *  - Use of OnOffApplication to generate CBR stream
  *  - IP flow monitor
  */
@@ -44,25 +44,23 @@
 #include "ns3/on-off-helper.h"
 #include "ns3/flow-monitor-helper.h"
 #include "ns3/ipv4-flow-classifier.h"
+#include "async-pcap.h"
+#include "fork-variants.h"
+#include "group-loss-model.h"
 
 using namespace ns3;
 
-/// Run single 10 seconds experiment
-void experiment (bool enableCtsRts, std::string wifiManager)
+/// What a variant needs from the scenario built at t=0
+struct Scenario
 {
-  
-  
-  // Enable or disable CTS/RTS based on argument enableCtsRts
-  //ctsThr is the frame size over which RTS/CTS will be applied
-  // It is set to a low value of enableRtsCts is true (so that)
-  // it's mostly applied, and set to a high value when enableRtsCts is fales
-  //so that it's mostly applied applied
-  
-  //This statement sets the threshold variable
-  UintegerValue ctsThr = (enableCtsRts ? UintegerValue (100) : UintegerValue (10000));
-  //This statement passes the threshold variable to the configuration method
-  Config::SetDefault ("ns3::WifiRemoteStationManager::RtsCtsThreshold", ctsThr);
+  NodeContainer nodes;
+  NetDeviceContainer devices;
+  YansWifiPhyHelper wifiPhy;
+};
 
+/// Build nodes, channel, devices, addresses and applications, everything up to Simulator::Run
+Scenario BuildScenario (std::string wifiManager)
+{
   // Declare a NodeContainer variable called "nodes"
   NodeContainer nodes;
   
@@ -75,22 +73,23 @@ void experiment (bool enableCtsRts, std::string wifiManager)
       nodes.Get (i)->AggregateObject (CreateObject<ConstantPositionMobilityModel> ());
     }
 
-  //Create propagation loss matrix. This is a matrix that defines the amount of loss
+  //Create propagation loss model. This defines the amount of loss between groups of nodes
   //in the signal strength that happens due to the distance it travels 
   // (Recall signal strength vs distance graph shown in class
  
- //First create the loss matrix object called "lossModel"
-  Ptr<MatrixPropagationLossModel> lossModel = CreateObject<MatrixPropagationLossModel> ();
+ //First create the loss model object called "lossModel"
+  Ptr<GroupPropagationLossModel> lossModel = CreateObject<GroupPropagationLossModel> ();
   // set default loss to 200 dB - so much loss that there's essentially no signal coverage
   lossModel->SetDefaultLoss (200); 
-  //See above: we are creating a model in which n0 - n1  and n1 - n2 are connected
-  //So set their loss to lesser amount
+  //See above: we are creating a model in which n0 - n1  and n0 - n2 are connected
+  //Node 0 is alone in group 0, the two hidden stations n1 and n2 form group 1
+  lossModel->SetNodeGroup (nodes.Get (0)->GetId (), 0);
+  lossModel->SetNodeGroup (nodes.Get (1)->GetId (), 1);
+  lossModel->SetNodeGroup (nodes.Get (2)->GetId (), 1);
   
-  // set symmetric loss 0 <-> 1 to 50 dB, good coverage
-    lossModel->SetLoss (nodes.Get (0)->GetObject<MobilityModel> (), nodes.Get (1)->GetObject<MobilityModel> (), 50); 
-  
-  // set symmetric loss 0 <-> 2 to 50 dB, good coverage
-    lossModel->SetLoss (nodes.Get (0)->GetObject<MobilityModel> (), nodes.Get (2)->GetObject<MobilityModel> (), 50); 
+  // set symmetric loss group 0 <-> group 1 to 50 dB, good coverage
+  // (n1 <-> n2, inside group 1, keeps the 200 dB default)
+  lossModel->SetLoss (0, 1, 50); 
   
   
   // Create a YansWifiChannel type object in the variable called "wifiChannel"
@@ -134,9 +133,6 @@ void experiment (bool enableCtsRts, std::string wifiManager)
  //represent the network interfaces of these nodes
   NetDeviceContainer devices = wifi.Install (wifiPhy, wifiMac, nodes);
 
-  // uncomment the following to have pcap output
-  wifiPhy.EnablePcap (enableCtsRts ? "rtscts-pcap-node" : "basic-pcap-node" , nodes);
-
 
   // Do the usual routine for Internet stack installation 
   
@@ -216,6 +212,27 @@ void experiment (bool enableCtsRts, std::string wifiManager)
 echoClientHelper.SetAttribute ("StartTime", TimeValue (Seconds ((double)2/1000)));
   pingApps.Add (echoClientHelper.Install (nodes.Get (2)));
 
+  Scenario scenario = { nodes, devices, wifiPhy };
+  return scenario;
+}
+
+/// Run single 8 seconds experiment on a freshly built (or forked) scenario
+void RunVariant (Scenario &scenario, bool enableCtsRts, const PcapOptions &pcap)
+{
+  // Enable or disable CTS/RTS based on argument enableCtsRts
+  //ctsThr is the frame size over which RTS/CTS will be applied
+  // It is set to a low value of enableRtsCts is true (so that)
+  // it's mostly applied, and set to a high value when enableRtsCts is fales
+  //so that it's mostly applied applied
+  
+  //This statement sets the threshold variable
+  UintegerValue ctsThr = (enableCtsRts ? UintegerValue (100) : UintegerValue (10000));
+  //The devices already exist, so set it on their station managers rather than as a default
+  Config::Set ("/NodeList/*/DeviceList/*/$ns3::WifiNetDevice/RemoteStationManager/RtsCtsThreshold", ctsThr);
+
+  // pcap output: per-node EnablePcap by default, or sampled/async capture of selected nodes
+  AsyncPcapWriter *pcapWriter = EnableWifiPcap (scenario.wifiPhy, enableCtsRts ? "rtscts-pcap-node" : "basic-pcap-node",
+                                                scenario.devices, pcap);
 
   // Install FlowMonitor on all nodes
   FlowMonitorHelper flowmon;
@@ -224,6 +241,7 @@ echoClientHelper.SetAttribute ("StartTime", TimeValue (Seconds ((double)2/1000))
   // Run simulation for 8 seconds
   Simulator::Stop (Seconds (8));
   Simulator::Run ();
+  std::cout << "Events processed = " << Simulator::GetEventCount () << std::endl;
 
   // Print per flow statistics
   monitor->CheckForLostPackets ();
@@ -254,6 +272,7 @@ echoClientHelper.SetAttribute ("StartTime", TimeValue (Seconds ((double)2/1000))
   std::cout << "Total channel throughput = " << totalTput << std::endl;
   // Cleanup
   Simulator::Destroy ();
+  delete pcapWriter;
 }
 
 int main (int argc, char **argv)
@@ -261,16 +280,37 @@ int main (int argc, char **argv)
   //Ignore this command line setup
 
   std::string wifiManager ("Arf");
+  PcapOptions pcap;
+  bool snapshot = false;
   CommandLine cmd;
   cmd.AddValue ("wifiManager", "Set wifi rate manager (Aarf, Aarfcd, Amrr, Arf, Cara, Ideal, Minstrel, Onoe, Rraa)", wifiManager);
+  cmd.AddValue ("snapshot", "Build the scenario once and fork one process per RTS/CTS setting", snapshot);
+  pcap.AddValues (cmd);
   cmd.Parse (argc, argv);
   //**Upto here
   
-  std::cout << "Hidden station experiment with RTS/CTS disabled:\n" << std::flush;
-  experiment (false, wifiManager);
-  std::cout << "------------------------------------------------\n";
-  std::cout << "Hidden station experiment with RTS/CTS enabled:\n";
-  experiment (true, wifiManager);
+  if (!snapshot)
+    {
+      std::cout << "Hidden station experiment with RTS/CTS disabled:\n" << std::flush;
+      Scenario basic = BuildScenario (wifiManager);
+      RunVariant (basic, false, pcap);
+      std::cout << "------------------------------------------------\n";
+      std::cout << "Hidden station experiment with RTS/CTS enabled:\n";
+      Scenario rtscts = BuildScenario (wifiManager);
+      RunVariant (rtscts, true, pcap);
+      return 0;
+    }
 
-  return 0;
+  // Same output, but the topology is built once and both runs branch from t=0
+  Scenario scenario = BuildScenario (wifiManager);
+  uint32_t failed = ForkVariants (2, [&] (uint32_t i) {
+    if (i > 0)
+      {
+        std::cout << "------------------------------------------------\n";
+      }
+    std::cout << "Hidden station experiment with RTS/CTS " << (i ? "enabled" : "disabled") << ":\n";
+    RunVariant (scenario, i == 1, pcap);
+  });
+  Simulator::Destroy ();
+  return failed ? 1 : 0;
 }
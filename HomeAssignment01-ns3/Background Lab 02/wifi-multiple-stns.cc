@@ -23,11 +23,13 @@
  *
  * This example illustrates the use of
  *  - Wifi in ad-hoc mode
- *  - Matrix propagation loss model
+ *  - Group (collision domain) propagation loss model
  *  - Use of OnOffApplication to generate CBR stream
  *  - IP flow monitor
  */
 
+#include <sstream>
+#include <vector>
 #include "ns3/command-line.h"
 #include "ns3/config.h"
 #include "ns3/uinteger.h"
@@ -44,28 +46,33 @@
 #include "ns3/on-off-helper.h"
 #include "ns3/flow-monitor-helper.h"
 #include "ns3/ipv4-flow-classifier.h"
+#include "flow-sampler.h"
+#include "async-pcap.h"
+#include "fork-variants.h"
+#include "group-loss-model.h"
 
 using namespace ns3;
 
-/// Run single 10 seconds experiment
-void experiment (bool enableCtsRts, std::string wifiManager)
+/// What a variant needs from the scenario built at t=0
+struct Scenario
 {
-  int num = 5;
- // double simulationTime = 3;                        /* Simulation time in seconds. */
+  int num;
+  NetDeviceContainer devices;
+  YansWifiPhyHelper wifiPhy;
+};
 
-   std::cout << "Num stations = ";
-   std::cin >> num;
-  
-  // Enable or disable CTS/RTS based on argument enableCtsRts
-  //ctsThr is the frame size over which RTS/CTS will be applied
-  // It is set to a low value of enableRtsCts is true (so that)
-  // it's mostly applied, and set to a high value when enableRtsCts is fales
-  //so that it's mostly applied applied
-  
-  //This statement sets the threshold variable
-  UintegerValue ctsThr = (enableCtsRts ? UintegerValue (100) : UintegerValue (10000));
-  //This statement passes the threshold variable to the configuration method
-  Config::SetDefault ("ns3::WifiRemoteStationManager::RtsCtsThreshold", ctsThr);
+/// One run of the experiment: RTS/CTS setting and CBR rate per station
+struct Variant
+{
+  bool enableCtsRts;
+  std::string dataRate;
+  std::string label;                     //!< prefix of the pcap and sample files
+};
+
+/// Build nodes, channel, devices, addresses and applications, everything up to Simulator::Run
+Scenario BuildScenario (std::string wifiManager, bool hiddenStations, int num, std::string dataRate)
+{
+ // double simulationTime = 3;                        /* Simulation time in seconds. */
 
   // Declare a NodeContainer variable called "nodes"
   NodeContainer nodes;
@@ -74,28 +81,31 @@ void experiment (bool enableCtsRts, std::string wifiManager)
   nodes.Create ((uint32_t) (num+1));
 
   // Place nodes somehow, this is required by every wireless simulation
-  for (uint8_t i = 0; i <= num; ++i)
+  for (int i = 0; i <= num; ++i)
     {
       nodes.Get (i)->AggregateObject (CreateObject<ConstantPositionMobilityModel> ());
     }
 
-  //Create propagation loss matrix. This is a matrix that defines the amount of loss
+  //Create propagation loss model. This defines the amount of loss between groups of nodes
   //in the signal strength that happens due to the distance it travels 
   // (Recall signal strength vs distance graph shown in class
  
- //First create the loss matrix object called "lossModel"
-  Ptr<MatrixPropagationLossModel> lossModel = CreateObject<MatrixPropagationLossModel> ();
-  // set default loss to 200 dB - so much loss that there's essentially no signal coverage
+ //First create the loss model object called "lossModel"
+  Ptr<GroupPropagationLossModel> lossModel = CreateObject<GroupPropagationLossModel> ();
+  // set default loss to 50 dB
   lossModel->SetDefaultLoss (50); 
-  //See above: we are creating a model in which n0 - n1  and n1 - n2 are connected
-  //So set their loss to lesser amount
+  //Node 0 is alone in group 0, all stations n1..num are in group 1
+  lossModel->SetNodeGroup (nodes.Get (0)->GetId (), 0);
+  for (int i = 1; i <= num; i++)
+    lossModel->SetNodeGroup (nodes.Get (i)->GetId (), 1);
   
-  // set symmetric loss 0 <-> 1 to 50 dB
+  // set symmetric loss 0 <-> stations to 50 dB
   /*double lossDB;
   std::cout << "Enter 0-i loss: ";
   std::cin >> lossDB; */
-  for (int i = 1; i <= num; i++)
-    lossModel->SetLoss (nodes.Get (0)->GetObject<MobilityModel> (), nodes.Get (i)->GetObject<MobilityModel> (), 50); 
+  lossModel->SetLoss (0, 1, 50); 
+  // stations hear each other (50 dB) unless they are all hidden from one another (200 dB)
+  lossModel->SetLoss (1, 1, hiddenStations ? 200 : 50); 
   
   // Create a YansWifiChannel type object in the variable called "wifiChannel"
   Ptr<YansWifiChannel> wifiChannel = CreateObject <YansWifiChannel> ();
@@ -141,9 +151,6 @@ void experiment (bool enableCtsRts, std::string wifiManager)
  //represent the network interfaces of these nodes
   NetDeviceContainer devices = wifi.Install (wifiPhy, wifiMac, nodes);
 
-  // uncomment the following to have pcap output
-  wifiPhy.EnablePcap (enableCtsRts ? "rtscts-pcap-node" : "basic-pcap-node" , nodes);
-
 
   // Do the usual routine for Internet stack installation 
   
@@ -180,10 +187,7 @@ void experiment (bool enableCtsRts, std::string wifiManager)
   
   //Packet size, ontime and offtime attributes of the OnOffHelper object
   uint32_t payloadSize = 2200;                       /* Transport layer payload size in bytes. */
-  std::string dataRate = "2Mbps"; 
-  
-  std::cout << "Datarate per node: ";
-  std::cin  >> dataRate;  
+  // dataRate per node comes from the command line
   
    onOffHelper.SetConstantRate(DataRate (dataRate), payloadSize);
   
@@ -228,14 +232,49 @@ void experiment (bool enableCtsRts, std::string wifiManager)
 
 //**************IGNORE THIS. LET IT BE.
 
+  Scenario scenario = { num, devices, wifiPhy };
+  return scenario;
+}
+
+/// Run single 8 seconds experiment on a freshly built (or forked) scenario
+void RunVariant (Scenario &scenario, const Variant &variant, double sampleInterval, const PcapOptions &pcap)
+{
+  int num = scenario.num;
+
+  // Enable or disable CTS/RTS based on argument enableCtsRts
+  //ctsThr is the frame size over which RTS/CTS will be applied
+  // It is set to a low value of enableRtsCts is true (so that)
+  // it's mostly applied, and set to a high value when enableRtsCts is fales
+  //so that it's mostly applied applied
+  
+  //This statement sets the threshold variable
+  UintegerValue ctsThr = (variant.enableCtsRts ? UintegerValue (100) : UintegerValue (10000));
+  //The devices already exist, so set it on their station managers rather than as a default
+  Config::Set ("/NodeList/*/DeviceList/*/$ns3::WifiNetDevice/RemoteStationManager/RtsCtsThreshold", ctsThr);
+  //The CBR sources are installed but not started yet, so their rate can still change
+  Config::Set ("/NodeList/*/ApplicationList/*/$ns3::OnOffApplication/DataRate",
+               DataRateValue (DataRate (variant.dataRate)));
+
+  // pcap output: per-node EnablePcap by default, or sampled/async capture of selected nodes
+  AsyncPcapWriter *pcapWriter = EnableWifiPcap (scenario.wifiPhy, variant.label + "-pcap-node",
+                                                scenario.devices, pcap);
 
   // Install FlowMonitor on all nodes
   FlowMonitorHelper flowmon;
   Ptr<FlowMonitor> monitor = flowmon.InstallAll ();
 
+  // Optionally stream per-interval flow statistics next to the end-of-run averages
+  FlowSampler *sampler = 0;
+  if (sampleInterval > 0)
+    {
+      sampler = new FlowSampler (monitor, Seconds (sampleInterval), variant.label + "-samples.csv");
+      sampler->Start (Seconds (0));
+    }
+
   // Run simulation for 10 seconds
   Simulator::Stop (Seconds (8));
   Simulator::Run ();
+  std::cout << "Events processed = " << Simulator::GetEventCount () << std::endl;
 
   // Print per flow statistics
   monitor->CheckForLostPackets ();
@@ -266,22 +305,83 @@ void experiment (bool enableCtsRts, std::string wifiManager)
   std::cout << "Total channel throughput = " << totalTput << std::endl;
   // Cleanup
   Simulator::Destroy ();
+  delete sampler;
+  delete pcapWriter;
 }
 
 int main (int argc, char **argv)
 {
   std::string wifiManager ("Arf");
+  double sampleInterval = 0; // seconds, 0 disables the time-series output
+  PcapOptions pcap;
+  bool hiddenStations = false;
+  int num = 5;                     // Num stations
+  std::string dataRate = "2Mbps";  // Datarate per node
+  std::string rtsCts = "both";     // off, on or both
+  bool snapshot = false;
   //Ignore this command line setup
   CommandLine cmd;
   cmd.AddValue ("wifiManager", "Set wifi rate manager (Aarf, Aarfcd, Amrr, Arf, Cara, Ideal, Minstrel, Onoe, Rraa)", wifiManager);
+  cmd.AddValue ("sampleInterval", "Per-flow statistics sampling interval in seconds (0 = off)", sampleInterval);
+  cmd.AddValue ("num", "Number of stations sending to node 0", num);
+  cmd.AddValue ("dataRate", "CBR data rate per station, or a comma separated list of rates to run", dataRate);
+  cmd.AddValue ("rtsCts", "Run with RTS/CTS off, on or both", rtsCts);
+  cmd.AddValue ("snapshot", "Build the scenario once and fork one process per variant", snapshot);
+  cmd.AddValue ("hiddenStations", "Stations only hear node 0, not each other", hiddenStations);
+  pcap.AddValues (cmd);
   cmd.Parse (argc, argv);
   //**Upto here
   
-  std::cout << "Hidden station experiment with RTS/CTS disabled:\n" << std::flush;
-  experiment (false, wifiManager);
-  std::cout << "------------------------------------------------\n";
-  std::cout << "Hidden station experiment with RTS/CTS enabled:\n";
-  experiment (true, wifiManager);
+  // Variants: RTS/CTS off and/or on, times every rate in the comma separated dataRate list
+  std::vector<Variant> variants;
+  for (int rts = 0; rts < 2; ++rts)
+    {
+      if ((rts == 0 && rtsCts == "on") || (rts == 1 && rtsCts == "off"))
+        {
+          continue;
+        }
+      std::istringstream rates (dataRate);
+      std::string rate;
+      while (std::getline (rates, rate, ','))
+        {
+          Variant v = { rts == 1, rate, rts ? "rtscts" : "basic" };
+          if (dataRate.find (',') != std::string::npos)
+            {
+              v.label += "-" + rate;
+            }
+          variants.push_back (v);
+        }
+    }
+
+  bool rateList = dataRate.find (',') != std::string::npos;
+  Scenario scenario;
+  auto run = [&] (uint32_t i) {
+    const Variant &v = variants[i];
+    if (i > 0)
+      {
+        std::cout << "------------------------------------------------\n";
+      }
+    std::cout << "Hidden station experiment with RTS/CTS " << (v.enableCtsRts ? "enabled" : "disabled")
+              << (rateList ? " at " + v.dataRate : "") << ":\n" << std::flush;
+    if (!snapshot)
+      {
+        scenario = BuildScenario (wifiManager, hiddenStations, num, v.dataRate);
+      }
+    RunVariant (scenario, v, sampleInterval, pcap);
+  };
 
-  return 0;
+  if (!snapshot)
+    {
+      for (uint32_t i = 0; i < variants.size (); ++i)
+        {
+          run (i);
+        }
+      return 0;
+    }
+
+  // Build once; every variant is forked from this t=0 state and only applies its own settings
+  scenario = BuildScenario (wifiManager, hiddenStations, num, variants[0].dataRate);
+  uint32_t failed = ForkVariants (variants.size (), run);
+  Simulator::Destroy ();
+  return failed ? 1 : 0;
 }
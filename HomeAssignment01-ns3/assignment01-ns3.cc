@@ -23,6 +23,7 @@
  *
  */
 
+#include <sstream>
 #include "ns3/command-line.h"
 #include "ns3/config.h"
 #include "ns3/uinteger.h"
@@ -44,17 +45,25 @@
 #include "ns3/udp-header.h"
 #include "ns3/enum.h"
 #include "ns3/event-id.h"
+#include "ns3/abort.h"
+#include "flow-sampler.h"
+#include "async-pcap.h"
+#include "group-loss-model.h"
+#include "steady-state.h"
+#include "flat-flow-monitor.h"
+#include "latency-histogram.h"
+#include "tcp-trace.h"
 
 
 using namespace ns3;
 //using namespace std;
 
-void experiment (bool enableCtsRts, std::string wifiManager)
+void experiment (bool enableCtsRts, std::string wifiManager, uint32_t M,
+                 uint32_t senderWindowSize, std::string dataRate, uint32_t payloadSize,
+                 double sampleInterval, std::string sampleFile, const PcapOptions &pcap,
+                 double steadyTol, double steadyBatch, bool flatMonitor,
+                 std::string tcpTrace, uint32_t tcpDecimation)
 {
-  int M = 4;
-  // Enter the number of nodes for simulation
-  std::cout << "Number of Nodes (M) [Multiple of 4] = ";
-  std::cin >> M;
 
   // Enable or disable CTS/RTS based on argument enableCtsRts
   //ctsThr is the frame size over which RTS/CTS will be applied
@@ -74,17 +83,18 @@ void experiment (bool enableCtsRts, std::string wifiManager)
   nodes.Create (M);
 
   // Place nodes somehow, this is required by every wireless simulation
-  for (uint8_t i = 0; i < M; ++i)
+  for (uint32_t i = 0; i < M; ++i)
     {
       nodes.Get (i)->AggregateObject (CreateObject<ConstantPositionMobilityModel> ());
     }
 
-  //Create propagation loss matrix. This is a matrix that defines the amount of loss
+  //Create propagation loss model. This defines the amount of loss
   //in the signal strength that happens due to the distance it travels 
   // (Recall signal strength vs distance graph shown in class
  
- //First create the loss matrix object called "lossModel"
-  Ptr<MatrixPropagationLossModel> lossModel = CreateObject<MatrixPropagationLossModel> ();
+ //First create the loss model object called "lossModel". All nodes hear each other
+ //(a full clique), so no groups are needed and every lookup is O(1)
+  Ptr<GroupPropagationLossModel> lossModel = CreateObject<GroupPropagationLossModel> ();
   // set default loss to 50 dB 
   lossModel->SetDefaultLoss (50); 
   
@@ -130,8 +140,9 @@ void experiment (bool enableCtsRts, std::string wifiManager)
  //represent the network interfaces of these nodes
   NetDeviceContainer devices = wifi.Install (wifiPhy, wifiMac, nodes);
 
-  // uncomment the following to have pcap output
-  wifiPhy.EnablePcap (enableCtsRts ? "rtscts-pcap-node" : "basic-pcap-node" , nodes);
+  // pcap output: per-node EnablePcap by default, or sampled/async capture of selected nodes
+  AsyncPcapWriter *pcapWriter = EnableWifiPcap (wifiPhy, enableCtsRts ? "rtscts-pcap-node" : "basic-pcap-node",
+                                                devices, pcap);
 
 
   // Do the usual routine for Internet stack installation 
@@ -159,17 +170,15 @@ void experiment (bool enableCtsRts, std::string wifiManager)
   
   //Declare the application container
   ApplicationContainer cbrApps;
+  LatencyRecorder latency;
   
  uint16_t cbrPort = 12345;
   
-  
- uint32_t payloadSize = 2200;          
-              
- std::string dataRate = "2Mbps";  // Transport layer payload size in bytes. 
+  // payloadSize (transport layer payload in bytes) and dataRate come from the command line
   
 //Now Install this helper object and add the application to the cbrApps container
 
-    for (uint8_t i = 0; i < M/2; i+=2){
+    for (uint32_t i = 0; i < M/2; i+=2){
        OnOffHelper onOffHelper ("ns3::UdpSocketFactory", InetSocketAddress (allIPs.GetAddress(i+1), cbrPort));
 	double startTimeCBR=0;
 	startTimeCBR = 1.0000+  (double) 1/100.0;  
@@ -177,6 +186,9 @@ void experiment (bool enableCtsRts, std::string wifiManager)
        onOffHelper.SetConstantRate(DataRate (dataRate), payloadSize);
 
        cbrApps.Add (onOffHelper.Install (nodes.Get (i)));
+       std::ostringstream label;
+       label << "CBR " << allIPs.GetAddress (i) << " -> " << allIPs.GetAddress (i+1);
+       latency.Watch (cbrApps.Get (cbrApps.GetN () - 1), nodes.Get (i+1), label.str ());
      }
 
 
@@ -192,13 +204,14 @@ void experiment (bool enableCtsRts, std::string wifiManager)
    //ns3::TcpSocket::SetDelAckMaxCount	(	(uint32_t) 	1)	
 
    
-   int senderWindowSize = 1100; //in bytes. This determines the sender window size used. 
-   std::cout<<"Window Size (in bytes) = ";
-   std::cin>>senderWindowSize;
+   //senderWindowSize (in bytes) determines the sender window size used. 
 
    Config::SetDefault ("ns3::TcpSocket::RcvBufSize", UintegerValue(senderWindowSize)); 
 
-   for (uint8_t i = M/2; i < M; i+=2) {
+   // Optionally record cwnd/ssthresh/RTT of every FTP sender
+   TcpTracer *tcpTracer = tcpTrace.empty () ? 0 : new TcpTracer (tcpTrace, tcpDecimation);
+
+   for (uint32_t i = M/2; i < M; i+=2) {
      BulkSendHelper source ("ns3::TcpSocketFactory",InetSocketAddress (allIPs.GetAddress(i+1), ftpPort));
      // Set the amount of data to send in bytes.  Zero is unlimited.
      source.SetAttribute ("MaxBytes", UintegerValue (maxBytes));
@@ -206,6 +219,10 @@ void experiment (bool enableCtsRts, std::string wifiManager)
 	double startTimeFTP =0;
      startTimeFTP = 1.0001+  (double) 1/100.0;  
      sourceApps.Start (Seconds (startTimeFTP));
+     if (tcpTracer)
+       {
+         tcpTracer->Add (DynamicCast<BulkSendApplication> (sourceApps.Get (0)), Seconds (startTimeFTP));
+       }
     
      PacketSinkHelper sinkFTP ("ns3::TcpSocketFactory",InetSocketAddress (Ipv4Address::GetAny(), ftpPort));
      ApplicationContainer sinkApps = sinkFTP.Install (nodes.Get (i+1));
@@ -223,22 +240,62 @@ void experiment (bool enableCtsRts, std::string wifiManager)
    * This is a workaround for the lack of perfect ARP, see \bugid{187}
    */
 
-  // Install FlowMonitor on all nodes
+  // Install FlowMonitor on all nodes, or the flat hash monitor in its place
+  NS_ABORT_MSG_IF (flatMonitor && (sampleInterval > 0 || steadyTol > 0),
+                   "sampleInterval and steadyTol need FlowMonitor, drop flatMonitor");
   FlowMonitorHelper flowmon;
-  Ptr<FlowMonitor> monitor = flowmon.InstallAll ();
+  Ptr<FlowMonitor> monitor;
+  FlatFlowMonitor *flat = 0;
+  if (flatMonitor)
+    {
+      flat = new FlatFlowMonitor ();
+      flat->InstallAll ();
+    }
+  else
+    {
+      monitor = flowmon.InstallAll ();
+    }
+
+  // Optionally stream per-interval flow statistics instead of keeping only the end-of-run averages
+  FlowSampler *sampler = 0;
+  if (sampleInterval > 0)
+    {
+      sampler = new FlowSampler (monitor, Seconds (sampleInterval), sampleFile);
+      sampler->Start (Seconds (0));
+    }
+
+  Ptr<Ipv4FlowClassifier> classifier = flat ? 0 : DynamicCast<Ipv4FlowClassifier> (flowmon.GetClassifier ());
+
+  // Optionally stop as soon as the CBR throughput has settled instead of always running 8 seconds
+  SteadyStateDetector *steady = 0;
+  if (steadyTol > 0)
+    {
+      steady = new SteadyStateDetector (monitor, classifier, Seconds (steadyBatch), steadyTol);
+      steady->Watch (cbrPort);
+      steady->Start (Seconds (0));
+    }
 
   Simulator::Stop (Seconds (8));
   Simulator::Run ();
+  std::cout << "Events processed = " << Simulator::GetEventCount () << std::endl;
+  if (steady)
+    {
+      steady->Report (std::cout);
+    }
 
   // Print per flow statistics
-  monitor->CheckForLostPackets ();
-  Ptr<Ipv4FlowClassifier> classifier = DynamicCast<Ipv4FlowClassifier> (flowmon.GetClassifier ());
-  FlowMonitor::FlowStatsContainer stats = monitor->GetFlowStats ();
-  double totalTput = 0.0, ftpDelay=0.0, ftpDelaySum=0.0, count=0, ftpTput =0.0;
+  if (monitor)
+    {
+      monitor->CheckForLostPackets ();
+    }
+  FlowMonitor::FlowStatsContainer stats = flat ? flat->GetFlowStats () : monitor->GetFlowStats ();
+  // A run stopped at steady state cuts the transfers short, so their delays mean nothing
+  bool truncated = steady && steady->IsConverged ();
+  double totalTput = 0.0, ftpDelay=0.0, ftpDelaySum=0.0, count=0, ftpTput =0.0, cbrTput = 0.0;
   for (std::map<FlowId, FlowMonitor::FlowStats>::const_iterator i = stats.begin (); i != stats.end (); ++i) {
 
       
-          Ipv4FlowClassifier::FiveTuple t = classifier->FindFlow (i->first);
+          Ipv4FlowClassifier::FiveTuple t = flat ? flat->FindFlow (i->first) : classifier->FindFlow (i->first);
           std::cout << "Flow " << i->first  << " (" << t.sourceAddress << ", " << t.sourcePort << " -> " 
                 << t.destinationAddress << ", " << t.destinationPort << ")\n";
           std::cout << "  Tx Packets: " << i->second.txPackets << "\n";
@@ -258,32 +315,73 @@ void experiment (bool enableCtsRts, std::string wifiManager)
           //Hint: observe the flow monitor variables used in calculation of "tput" above (denominator). 
           //Complete below line and uncomment
 		  ftpDelay =  i->second.timeLastRxPacket.GetSeconds()-i->second.timeFirstTxPacket.GetSeconds();
-		  std::cout << "Full Data transfer delay = "  << ftpDelay  << " seconds " << std::endl  ;
+		  if (!truncated) { std::cout << "Full Data transfer delay = "  << ftpDelay  << " seconds " << std::endl  ; }
 		  if (t.destinationPort == 54321) { ftpDelaySum +=  ftpDelay; count++; ftpTput += tput;}
+		  if (t.destinationPort == cbrPort) { cbrTput += tput; }
 
 
 
   }
   std::cout << "Total channel throughput = " << totalTput << "Mbps" << std::endl;
+  std::cout << "CBR throughput = " << cbrTput << "Mbps" << std::endl;
   std::cout << "FTP throughput = " << ftpTput << "Mbps" << std::endl;
- std::cout << "Average File Transfer Delay = " << ftpDelaySum/count << " seconds" << std::endl;
+ if (truncated)
+   {
+     std::cout << "File transfer delays not reported: stopped at steady state" << std::endl;
+   }
+ else
+   {
+     std::cout << "Average File Transfer Delay = " << ftpDelaySum/count << " seconds" << std::endl;
+   }
+  latency.Report (std::cout);
  
 
   // Cleanup
   Simulator::Destroy ();
+  delete sampler;
+  delete steady;
+  delete flat;
+  delete tcpTracer;
+  delete pcapWriter;
 }
 
 int main (int argc, char **argv)
 {
   std::string wifiManager ("Arf");
+  uint32_t M = 4;                   // Number of nodes [Multiple of 4]
+  uint32_t senderWindowSize = 1100; // in bytes
+  std::string dataRate = "2Mbps";   // per CBR flow
+  uint32_t payloadSize = 2200;      // CBR transport layer payload size in bytes
+  double sampleInterval = 0;        // seconds, 0 disables the time-series output
+  std::string sampleFile = "assignment01-samples.csv";
+  double steadyTol = 0;             // relative CI half-width, 0 always runs the full 8 seconds
+  double steadyBatch = 0.1;         // seconds
+  bool flatMonitor = false;
+  std::string tcpTrace = "";        // binary cwnd/RTT trace of the FTP senders, empty disables it
+  uint32_t tcpDecimation = 1;
+  PcapOptions pcap;
   //Ignore this command line setup
   CommandLine cmd;
   cmd.AddValue ("wifiManager", "Set wifi rate manager (Aarf, Aarfcd, Amrr, Arf, Cara, Ideal, Minstrel, Onoe, Rraa)", wifiManager);
+  cmd.AddValue ("M", "Number of nodes (multiple of 4)", M);
+  cmd.AddValue ("senderWindowSize", "TCP receive buffer / sender window size in bytes", senderWindowSize);
+  cmd.AddValue ("dataRate", "Data rate of each CBR flow", dataRate);
+  cmd.AddValue ("payloadSize", "CBR payload size in bytes", payloadSize);
+  cmd.AddValue ("sampleInterval", "Per-flow statistics sampling interval in seconds (0 = off)", sampleInterval);
+  cmd.AddValue ("sampleFile", "CSV file for the per-flow time series", sampleFile);
+  cmd.AddValue ("steadyTol", "Stop once the CBR throughput 95% CI is within this fraction of its mean (0 = off)", steadyTol);
+  cmd.AddValue ("steadyBatch", "Batch length in seconds for the steady-state test", steadyBatch);
+  cmd.AddValue ("tcpTrace", "Binary cwnd/ssthresh/RTT trace of the FTP senders (see tcp-trace.h)", tcpTrace);
+  cmd.AddValue ("tcpDecimation", "Keep only every n-th change of each traced TCP variable", tcpDecimation);
+  cmd.AddValue ("flatMonitor", "Account flows with the flat hash table monitor instead of FlowMonitor", flatMonitor);
+  pcap.AddValues (cmd);
   cmd.Parse (argc, argv);
   //**Upto here
   
   std::cout << "FTP-CBR Experiment with RTS/CTS disabled:\n" << std::flush;
-  experiment (false, wifiManager);
+  experiment (false, wifiManager, M, senderWindowSize, dataRate, payloadSize,
+              sampleInterval, sampleFile, pcap, steadyTol, steadyBatch, flatMonitor,
+              tcpTrace, tcpDecimation);
   std::cout << "------------------------------------------------\n";
 
   return 0;
@@ -0,0 +1,392 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Sampled, asynchronous pcap capture for WifiNetDevices.
+ *
+ * wifiPhy.EnablePcap () writes one file per node synchronously from inside
+ * the event loop. AsyncPcapWriter instead hooks the MonitorSnifferTx/Rx
+ * trace sources of the selected nodes only, keeps 1 in N frames, truncates
+ * them to snaplen and appends the records to an in-memory buffer. A full
+ * buffer is queued for a background thread that does the file I/O with
+ * the lock released, and the simulator carries on in a spare buffer from a
+ * small pool. When the disk falls so far behind that the pool is empty,
+ * the current buffer keeps growing instead (counted as an overrun and
+ * reported by Close), so the event loop never waits for the disk.
+ *
+ * Files are opened by the writer thread when it has records for them and
+ * at most MAX_OPEN at a time (least recently used are closed and later
+ * reopened for appending), so large M stays below the descriptor limit.
+ * Each queued buffer is written grouped by file.
+ *
+ * The files use the same "prefix-node-device.pcap" names and 802.11 link
+ * type as EnablePcap, so existing post-processing keeps working.
+ *
+ * Copy this header next to the script in scratch/ to use it.
+ */
+
+#ifndef ASYNC_PCAP_H
+#define ASYNC_PCAP_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ns3/abort.h"
+#include "ns3/command-line.h"
+#include "ns3/simulator.h"
+#include "ns3/packet.h"
+#include "ns3/node-container.h"
+#include "ns3/net-device-container.h"
+#include "ns3/wifi-net-device.h"
+#include "ns3/wifi-phy.h"
+#include "ns3/yans-wifi-helper.h"
+
+namespace ns3 {
+
+class AsyncPcapWriter
+{
+public:
+  /**
+   * \param snaplen bytes kept of every frame, 0 keeps whole frames
+   * \param sample keep one frame out of every sample frames seen by a device
+   * \param bufferBytes size of the buffer handed to the writer thread at once
+   * \param buffers buffers in the pool, including the one being filled
+   */
+  AsyncPcapWriter (uint32_t snaplen, uint32_t sample, size_t bufferBytes = 4 << 20, uint32_t buffers = 4)
+    : m_snaplen (snaplen ? snaplen : 65535),
+      m_sample (sample ? sample : 1),
+      m_bufferBytes (bufferBytes),
+      m_done (false),
+      m_closed (false),
+      m_overruns (0),
+      m_flushAt (bufferBytes),
+      m_open (0),
+      m_clock (0)
+  {
+    m_front.reserve (m_bufferBytes + 2 * m_snaplen);
+    for (uint32_t i = 1; i < std::max (buffers, 2u); ++i)
+      {
+        m_free.push_back (std::vector<char> ());
+        m_free.back ().reserve (m_bufferBytes + 2 * m_snaplen);
+      }
+    m_thread = std::thread (&AsyncPcapWriter::Run, this);
+  }
+
+  ~AsyncPcapWriter ()
+  {
+    Close ();
+  }
+
+  /// Capture every frame sent or received by device, into prefix-node-device.pcap
+  void Install (std::string prefix, Ptr<NetDevice> device)
+  {
+    Ptr<WifiNetDevice> wifi = DynamicCast<WifiNetDevice> (device);
+    NS_ABORT_MSG_IF (wifi == 0, "AsyncPcapWriter only supports WifiNetDevice");
+
+    std::ostringstream name;
+    name << prefix << "-" << device->GetNode ()->GetId () << "-" << device->GetIfIndex () << ".pcap";
+    FILE *file = std::fopen (name.str ().c_str (), "wb");
+    NS_ABORT_MSG_IF (file == 0, "Cannot open " << name.str ());
+    // Classic pcap global header, 802.11 link type (DLT_IEEE802_11 = 105);
+    // the records are appended by the writer thread
+    uint32_t header[6] = { 0xa1b2c3d4, 0x00040002, 0, 0, m_snaplen, 105 };
+    std::fwrite (header, sizeof (header), 1, file);
+    std::fclose (file);
+
+    Tap *tap = new Tap;
+    tap->writer = this;
+    tap->file = m_files.size ();
+    tap->seen = 0;
+    m_names.push_back (name.str ());
+    m_files.push_back (0);
+    m_lastUse.push_back (0);
+    m_taps.push_back (tap);
+    wifi->GetPhy ()->TraceConnectWithoutContext ("MonitorSnifferTx", MakeCallback (&Tap::Tx, tap));
+    wifi->GetPhy ()->TraceConnectWithoutContext ("MonitorSnifferRx", MakeCallback (&Tap::Rx, tap));
+  }
+
+  /// Hand the remaining records to the writer thread, wait for them and close all files
+  void Close ()
+  {
+    if (m_closed)
+      {
+        return;
+      }
+    m_closed = true;
+    {
+      std::unique_lock<std::mutex> lock (m_mutex);
+      m_full.push_back (std::vector<char> ());
+      m_full.back ().swap (m_front);
+      m_done = true;
+    }
+    m_cond.notify_all ();
+    m_thread.join ();
+    for (size_t i = 0; i < m_files.size (); ++i)
+      {
+        if (m_files[i])
+          {
+            std::fclose (m_files[i]);
+          }
+        delete m_taps[i];
+      }
+    m_files.clear ();
+    m_taps.clear ();
+    if (m_overruns)
+      {
+        std::cerr << "AsyncPcapWriter: the disk fell behind, " << m_overruns
+                  << " buffer overruns (more memory was used instead)\n";
+      }
+  }
+
+  /// Times a full buffer found no spare one in the pool and grew instead
+  uint64_t GetOverruns () const
+  {
+    return m_overruns;
+  }
+
+  enum { MAX_OPEN = 256 };
+
+private:
+  /// Per-device trace sink, remembers which file it writes to
+  struct Tap
+  {
+    AsyncPcapWriter *writer;
+    uint32_t file;
+    uint64_t seen;
+
+    void Tx (Ptr<const Packet> packet, uint16_t channelFreqMhz, WifiTxVector txVector, MpduInfo aMpdu)
+    {
+      if (seen++ % writer->m_sample == 0)
+        {
+          writer->Append (file, packet);
+        }
+    }
+    void Rx (Ptr<const Packet> packet, uint16_t channelFreqMhz, WifiTxVector txVector, MpduInfo aMpdu,
+             SignalNoiseDbm signalNoise)
+    {
+      if (seen++ % writer->m_sample == 0)
+        {
+          writer->Append (file, packet);
+        }
+    }
+  };
+
+  /// Buffer layout per record: file index, pcap record header, frame bytes
+  void Append (uint32_t file, Ptr<const Packet> packet)
+  {
+    uint32_t len = packet->GetSize ();
+    uint32_t caplen = std::min (len, m_snaplen);
+    int64_t us = Simulator::Now ().GetMicroSeconds ();
+    uint32_t record[5] = { file, static_cast<uint32_t> (us / 1000000),
+                           static_cast<uint32_t> (us % 1000000), caplen, len };
+    size_t offset = m_front.size ();
+    m_front.resize (offset + sizeof (record) + caplen);
+    std::memcpy (&m_front[offset], record, sizeof (record));
+    packet->CopyData (reinterpret_cast<uint8_t *> (&m_front[offset + sizeof (record)]), caplen);
+    if (m_front.size () >= m_flushAt)
+      {
+        Flush ();
+      }
+  }
+
+  /// Queue the filled front buffer and continue in a spare one; without a spare one keep growing
+  void Flush ()
+  {
+    {
+      std::unique_lock<std::mutex> lock (m_mutex);
+      if (m_free.empty ())
+        {
+          m_overruns++;
+          // Try again once the buffer has grown by another bufferBytes
+          m_front.reserve (m_front.size () + m_bufferBytes + 2 * m_snaplen);
+          m_flushAt = m_front.size () + m_bufferBytes;
+          return;
+        }
+      m_full.push_back (std::vector<char> ());
+      m_full.back ().swap (m_front);
+      m_front.swap (m_free.back ());
+      m_free.pop_back ();
+      m_flushAt = m_bufferBytes;
+    }
+    m_cond.notify_all ();
+  }
+
+  /// Writer thread: write the queued buffers to the per-device files, without holding the lock
+  void Run ()
+  {
+    std::vector<char> buffer;
+    std::vector<std::pair<uint32_t, size_t> > records;  // file, offset
+    for (;;)
+      {
+        {
+          std::unique_lock<std::mutex> lock (m_mutex);
+          if (buffer.capacity ())
+            {
+              m_free.push_back (std::vector<char> ());
+              m_free.back ().swap (buffer);
+            }
+          m_cond.wait (lock, [this] { return m_done || !m_full.empty (); });
+          if (m_full.empty ())
+            {
+              return;
+            }
+          buffer.swap (m_full.front ());
+          m_full.pop_front ();
+        }
+        records.clear ();
+        for (size_t pos = 0; pos < buffer.size ();)
+          {
+            uint32_t record[5];
+            std::memcpy (record, &buffer[pos], sizeof (record));
+            records.push_back (std::make_pair (record[0], pos));
+            pos += sizeof (record) + record[3];
+          }
+        // One open per file and buffer; the stable sort keeps each file's records in time order
+        std::stable_sort (records.begin (), records.end (),
+                          [] (const std::pair<uint32_t, size_t> &a, const std::pair<uint32_t, size_t> &b) {
+                            return a.first < b.first;
+                          });
+        for (size_t i = 0; i < records.size (); ++i)
+          {
+            uint32_t record[5];
+            std::memcpy (record, &buffer[records[i].second], sizeof (record));
+            std::fwrite (&buffer[records[i].second + 4], sizeof (record) - 4 + record[3], 1, File (record[0]));
+          }
+        buffer.clear ();
+      }
+  }
+
+  /// Open file for appending, closing the least recently used one when MAX_OPEN are open
+  FILE *File (uint32_t file)
+  {
+    m_lastUse[file] = ++m_clock;
+    if (m_files[file])
+      {
+        return m_files[file];
+      }
+    if (m_open >= MAX_OPEN)
+      {
+        uint32_t victim = 0;
+        for (uint32_t i = 0; i < m_files.size (); ++i)
+          {
+            if (m_files[i] && (!m_files[victim] || m_lastUse[i] < m_lastUse[victim]))
+              {
+                victim = i;
+              }
+          }
+        std::fclose (m_files[victim]);
+        m_files[victim] = 0;
+        m_open--;
+      }
+    m_files[file] = std::fopen (m_names[file].c_str (), "ab");
+    NS_ABORT_MSG_IF (m_files[file] == 0, "Cannot open " << m_names[file]);
+    std::setvbuf (m_files[file], 0, _IOFBF, 1 << 16);
+    m_open++;
+    return m_files[file];
+  }
+
+  uint32_t m_snaplen;
+  uint32_t m_sample;
+  size_t m_bufferBytes;
+  bool m_done;                 //!< no more buffers will be queued
+  bool m_closed;
+  uint64_t m_overruns;
+  size_t m_flushAt;            //!< front buffer size that triggers the next Flush
+  std::vector<char> m_front;   //!< filled by the simulator
+  std::deque<std::vector<char> > m_full;   //!< waiting for the writer thread
+  std::vector<std::vector<char> > m_free;  //!< spare buffers
+  std::vector<std::string> m_names;
+  std::vector<FILE *> m_files;             //!< writer thread only, 0 while closed
+  std::vector<uint64_t> m_lastUse;
+  uint32_t m_open;
+  uint64_t m_clock;
+  std::vector<Tap *> m_taps;
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+  std::thread m_thread;
+};
+
+/// Capture settings shared by the wifi scripts
+struct PcapOptions
+{
+  std::string mode = "sync";  //!< sync (wifiPhy.EnablePcap), async or none
+  std::string nodes = "all";  //!< "all" or a list of node indices/ranges, e.g. "0,2,5-9"
+  uint32_t snaplen = 0;       //!< async only, 0 keeps whole frames
+  uint32_t sample = 1;        //!< async only, keep 1 in N frames per device
+
+  void AddValues (CommandLine &cmd)
+  {
+    cmd.AddValue ("pcapMode", "Pcap capture: sync (one EnablePcap per node), async or none", mode);
+    cmd.AddValue ("pcapNodes", "Nodes to capture: all or a list like 0,2,5-9", nodes);
+    cmd.AddValue ("pcapSnaplen", "Bytes kept per captured frame in async mode (0 = all)", snaplen);
+    cmd.AddValue ("pcapSample", "Keep one in N frames per node in async mode", sample);
+  }
+
+  /// Indices of the selected nodes among count nodes
+  std::vector<uint32_t> Selected (uint32_t count) const
+  {
+    std::vector<uint32_t> selected;
+    if (nodes == "all")
+      {
+        for (uint32_t i = 0; i < count; ++i)
+          {
+            selected.push_back (i);
+          }
+        return selected;
+      }
+    std::istringstream list (nodes);
+    std::string item;
+    while (std::getline (list, item, ','))
+      {
+        size_t dash = item.find ('-');
+        uint32_t first = std::atoi (item.substr (0, dash).c_str ());
+        uint32_t last = dash == std::string::npos ? first : std::atoi (item.substr (dash + 1).c_str ());
+        for (uint32_t i = first; i <= last && i < count; ++i)
+          {
+            selected.push_back (i);
+          }
+      }
+    return selected;
+  }
+};
+
+/**
+ * Enable capture on the selected nodes according to options. Returns the
+ * async writer (to be deleted after Simulator::Run) or 0 for the other modes.
+ */
+inline AsyncPcapWriter *
+EnableWifiPcap (YansWifiPhyHelper &wifiPhy, std::string prefix, NetDeviceContainer devices,
+                const PcapOptions &options)
+{
+  std::vector<uint32_t> selected = options.Selected (devices.GetN ());
+  if (options.mode == "none")
+    {
+      return 0;
+    }
+  if (options.mode == "sync")
+    {
+      for (size_t i = 0; i < selected.size (); ++i)
+        {
+          wifiPhy.EnablePcap (prefix, devices.Get (selected[i]));
+        }
+      return 0;
+    }
+  NS_ABORT_MSG_IF (options.mode != "async", "Unknown pcapMode " << options.mode);
+  AsyncPcapWriter *writer = new AsyncPcapWriter (options.snaplen, options.sample);
+  for (size_t i = 0; i < selected.size (); ++i)
+    {
+      writer->Install (prefix, devices.Get (selected[i]));
+    }
+  return writer;
+}
+
+} // namespace ns3
+
+#endif /* ASYNC_PCAP_H */
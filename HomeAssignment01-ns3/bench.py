@@ -0,0 +1,156 @@
+"""Simulator performance benchmark for the ns-3 scripts
+
+Runs every scenario at a range of scales, one process at a time so the
+timings don't disturb each other, and records for each run the wall time,
+the number of simulator events and events per second, the peak resident
+set size and the bytes written (stdout plus every file the run created in
+its own working directory). Compare two result tables to catch speed
+regressions.
+
+Example (run after `./waf build` in the ns-3 tree):
+    python3 bench.py --ns3-dir ~/ns-3.30 -o bench.csv
+    python3 bench.py --ns3-dir ~/ns-3.30 --scenario assignment01 --scales 4,64,1024
+    python3 bench.py --ns3-dir ~/ns-3.30 --baseline old-bench.csv
+"""
+
+import argparse
+import csv
+import os
+import re
+import shutil
+import subprocess
+import sys
+import threading
+import time
+from collections import OrderedDict
+
+from sweep import binary_path, point_dir
+
+# name: (program, scale parameter or None, default scales, fixed arguments)
+SCENARIOS = OrderedDict([
+    ("cbr-only", ("CBRonly", "endTime", [5, 20, 80], {})),
+    ("ftp-only", ("FTPonly", "endTime", [5, 20, 80], {})),
+    ("ftp-cbr", ("FTP_CBR", "endTime", [5, 20, 80], {})),
+    ("wifi-2hidden", ("wifi-2hidden-stns", None, [None], {"pcapMode": "none"})),
+    ("wifi-multiple", ("wifi-multiple-stns", "num", [1, 4, 16, 64],
+                       {"rtsCts": "off", "pcapMode": "none"})),
+    ("assignment01", ("assignment01-ns3", "M", [4, 16, 64, 256, 1024], {"pcapMode": "none"})),
+])
+
+EVENTS = re.compile(r"Events processed = (\d+)")
+
+
+def directory_bytes(path):
+    total = 0
+    for root, _, files in os.walk(path):
+        for name in files:
+            total += os.path.getsize(os.path.join(root, name))
+    return total
+
+
+def run_once(ns3_dir, program, params, timeout=None, workdir="bench-runs"):
+    """Run one simulation and measure it; stdout goes to a file in the run directory."""
+    env = dict(os.environ)
+    libdir = os.path.abspath(os.path.join(ns3_dir, "build", "lib"))
+    env["LD_LIBRARY_PATH"] = libdir + os.pathsep + env.get("LD_LIBRARY_PATH", "")
+    cwd = point_dir(workdir, OrderedDict([("program", program)] + list(params.items())))
+    shutil.rmtree(cwd)
+    os.makedirs(cwd)
+    args = [binary_path(ns3_dir, program)] + ["--%s=%s" % kv for kv in params.items()]
+
+    with open(os.path.join(cwd, "stdout.txt"), "w") as out:
+        start = time.perf_counter()
+        proc = subprocess.Popen(args, env=env, cwd=cwd, stdin=subprocess.DEVNULL,
+                                stdout=out, stderr=subprocess.DEVNULL)
+        timer = threading.Timer(timeout, proc.kill) if timeout else None
+        if timer:
+            timer.start()
+        # wait4 gives this child's own rusage; Popen.wait would discard it
+        _, status, usage = os.wait4(proc.pid, 0)
+        wall = time.perf_counter() - start
+        proc.returncode = -os.WTERMSIG(status) if os.WIFSIGNALED(status) else os.WEXITSTATUS(status)
+        if timer:
+            timer.cancel()
+
+    with open(os.path.join(cwd, "stdout.txt")) as f:
+        events = sum(int(n) for n in EVENTS.findall(f.read()))
+    row = OrderedDict()
+    row["wall_s"] = round(wall, 3)
+    row["cpu_s"] = round(usage.ru_utime + usage.ru_stime, 3)
+    row["events"] = events
+    row["events_per_s"] = round(events / wall) if wall > 0 else ""
+    row["peak_rss_mb"] = round(usage.ru_maxrss / 1024.0, 1)  # ru_maxrss is in kB on Linux
+    row["output_bytes"] = directory_bytes(cwd)
+    if proc.returncode == 0:
+        row["status"] = "ok"
+    elif timer and proc.returncode < 0:
+        row["status"] = "timeout"
+    else:
+        row["status"] = "exit %d" % proc.returncode
+    return row
+
+
+def load_baseline(path):
+    with open(path, newline="") as f:
+        return {(r["scenario"], r["scale"]): r for r in csv.DictReader(f)}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--ns3-dir", default=".", help="ns-3 source tree containing build/")
+    parser.add_argument("--scenario", action="append", choices=list(SCENARIOS),
+                        help="scenario to run (repeatable, default all)")
+    parser.add_argument("--scales", help="comma separated scales, overriding the defaults")
+    parser.add_argument("--repeat", type=int, default=1, help="runs per scale; the fastest is kept")
+    parser.add_argument("--timeout", type=float, default=None, help="per-run timeout (s)")
+    parser.add_argument("--workdir", default="bench-runs", help="per-run working directories")
+    parser.add_argument("--baseline", help="earlier bench.csv; runs slower by --tolerance are flagged")
+    parser.add_argument("--tolerance", type=float, default=0.10,
+                        help="relative events/s drop that counts as a regression")
+    parser.add_argument("-o", "--output", default="bench.csv", help="results table (CSV)")
+    args = parser.parse_args()
+
+    baseline = load_baseline(args.baseline) if args.baseline else {}
+    rows = []
+    regressions = 0
+    for name in args.scenario or SCENARIOS:
+        program, param, scales, fixed = SCENARIOS[name]
+        if args.scales and param:
+            scales = args.scales.split(",")
+        for scale in scales:
+            params = OrderedDict(fixed)
+            if param:
+                params[param] = scale
+            best = None
+            for _ in range(args.repeat):
+                r = run_once(args.ns3_dir, program, params, args.timeout, args.workdir)
+                if best is None or (r["status"] == "ok" and r["wall_s"] < best["wall_s"]):
+                    best = r
+            row = OrderedDict([("scenario", name), ("program", program),
+                               ("scale", "" if scale is None else "%s=%s" % (param, scale))])
+            row.update(best)
+            old = baseline.get((row["scenario"], row["scale"]))
+            row["vs_baseline"] = ""
+            if old and old.get("events_per_s") and row["events_per_s"]:
+                ratio = float(row["events_per_s"]) / float(old["events_per_s"])
+                row["vs_baseline"] = round(ratio, 3)
+                if ratio < 1 - args.tolerance:
+                    regressions += 1
+            rows.append(row)
+            print("%-14s %-12s %8.2f s %12s ev/s %8.1f MB %10d B  %s" %
+                  (name, row["scale"], row["wall_s"], row["events_per_s"], row["peak_rss_mb"],
+                   row["output_bytes"], row["status"]), file=sys.stderr)
+
+    with open(args.output, "w", newline="") as f:
+        writer = csv.DictWriter(f, fieldnames=list(rows[0]))
+        writer.writeheader()
+        writer.writerows(rows)
+    if regressions:
+        print("%d run(s) slower than the baseline by more than %g%%" %
+              (regressions, args.tolerance * 100), file=sys.stderr)
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
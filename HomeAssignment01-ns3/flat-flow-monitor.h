@@ -0,0 +1,337 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Per-flow accounting with a flat hash classifier.
+ *
+ * FlowMonitor classifies every packet through Ipv4FlowClassifier, which
+ * keeps its five-tuples in ordered maps, and keeps FlowStats in a map too.
+ * Here the five-tuple is packed into two 64-bit words and looked up in an
+ * open-addressing (linear probing) table, and the stats of flow id are
+ * element id - 1 of one vector. The probe hooks the same trace sources as
+ * Ipv4FlowProbe (the Ipv4L3Protocol ones, and the Drop traces of the device
+ * transmit queues and root queue discs) and tags each sent packet with its
+ * flow id and send time, so receivers account delay without classifying
+ * again.
+ *
+ * lostPackets counts the drops seen on those traces, so install the
+ * monitor after the traffic control layer has its queue discs. Unlike
+ * FlowMonitor it does not add packets that are merely overdue after
+ * CheckForLostPackets, nor drops inside MACs without a TxQueue attribute
+ * (e.g. the wifi MAC queues), which FlowMonitor does not see either.
+ *
+ * GetFlowStats/FindFlow return the FlowMonitor/Ipv4FlowClassifier types,
+ * so the usual reporting loop works unchanged on the results. Histograms
+ * are not kept.
+ *
+ * Copy this header next to the script in scratch/ to use it.
+ */
+
+#ifndef FLAT_FLOW_MONITOR_H
+#define FLAT_FLOW_MONITOR_H
+
+#include <vector>
+#include "ns3/flow-monitor.h"
+#include "ns3/ipv4-flow-classifier.h"
+#include "ns3/ipv4-l3-protocol.h"
+#include "ns3/net-device.h"
+#include "ns3/node-container.h"
+#include "ns3/packet.h"
+#include "ns3/pointer.h"
+#include "ns3/queue.h"
+#include "ns3/queue-disc.h"
+#include "ns3/simulator.h"
+#include "ns3/tag.h"
+#include "ns3/traffic-control-layer.h"
+
+namespace ns3 {
+
+/// Flow id and send time carried by every packet the monitor saw leave its source
+class FlatFlowTag : public Tag
+{
+public:
+  static TypeId GetTypeId (void)
+  {
+    static TypeId tid = TypeId ("ns3::FlatFlowTag")
+      .SetParent<Tag> ()
+      .SetGroupName ("FlowMonitor")
+      .AddConstructor<FlatFlowTag> ()
+    ;
+    return tid;
+  }
+  virtual TypeId GetInstanceTypeId (void) const
+  {
+    return GetTypeId ();
+  }
+  virtual uint32_t GetSerializedSize (void) const
+  {
+    return 4 + 8;
+  }
+  virtual void Serialize (TagBuffer buf) const
+  {
+    buf.WriteU32 (flowId);
+    buf.WriteU64 (static_cast<uint64_t> (txTime));
+  }
+  virtual void Deserialize (TagBuffer buf)
+  {
+    flowId = buf.ReadU32 ();
+    txTime = static_cast<int64_t> (buf.ReadU64 ());
+  }
+  virtual void Print (std::ostream &os) const
+  {
+    os << "FlowId=" << flowId << " TxTime=" << txTime;
+  }
+
+  uint32_t flowId = 0;
+  int64_t txTime = 0;                    //!< Time::GetTimeStep () at the source
+};
+
+class FlatFlowMonitor
+{
+public:
+  FlatFlowMonitor ()
+    : m_mask (1023),
+      m_slots (1024)
+  {
+  }
+
+  /// Hook the IPv4 stack, device queues and queue discs of every node that has an IPv4 stack
+  void Install (NodeContainer nodes)
+  {
+    for (NodeContainer::Iterator i = nodes.Begin (); i != nodes.End (); ++i)
+      {
+        Ptr<Ipv4L3Protocol> ipv4 = (*i)->GetObject<Ipv4L3Protocol> ();
+        if (!ipv4)
+          {
+            continue;
+          }
+        ipv4->TraceConnectWithoutContext ("SendOutgoing", MakeCallback (&FlatFlowMonitor::SendOutgoing, this));
+        ipv4->TraceConnectWithoutContext ("UnicastForward", MakeCallback (&FlatFlowMonitor::Forward, this));
+        ipv4->TraceConnectWithoutContext ("LocalDeliver", MakeCallback (&FlatFlowMonitor::LocalDeliver, this));
+        ipv4->TraceConnectWithoutContext ("Drop", MakeCallback (&FlatFlowMonitor::Drop, this));
+        Ptr<TrafficControlLayer> tc = (*i)->GetObject<TrafficControlLayer> ();
+        for (uint32_t d = 0; d < (*i)->GetNDevices (); ++d)
+          {
+            Ptr<NetDevice> device = (*i)->GetDevice (d);
+            PointerValue queue;
+            if (device->GetAttributeFailSafe ("TxQueue", queue) && queue.Get<Queue<Packet> > ())
+              {
+                queue.Get<Queue<Packet> > ()->TraceConnectWithoutContext (
+                  "Drop", MakeCallback (&FlatFlowMonitor::QueueDrop, this));
+              }
+            if (tc && tc->GetRootQueueDiscOnDevice (device))
+              {
+                tc->GetRootQueueDiscOnDevice (device)->TraceConnectWithoutContext (
+                  "Drop", MakeCallback (&FlatFlowMonitor::QueueDiscDrop, this));
+              }
+          }
+      }
+  }
+
+  void InstallAll ()
+  {
+    Install (NodeContainer::GetGlobal ());
+  }
+
+  uint32_t GetNFlows () const
+  {
+    return m_flows.size ();
+  }
+
+  /// FlowMonitor style stats of every flow (built on each call, meant for the end of the run)
+  FlowMonitor::FlowStatsContainer GetFlowStats () const
+  {
+    FlowMonitor::FlowStatsContainer stats;
+    for (uint32_t i = 0; i < m_flows.size (); ++i)
+      {
+        const Flow &f = m_flows[i];
+        FlowMonitor::FlowStats &s = stats[i + 1];
+        s.timeFirstTxPacket = TimeStep (f.firstTx);
+        s.timeLastTxPacket = TimeStep (f.lastTx);
+        s.timeFirstRxPacket = TimeStep (f.firstRx);
+        s.timeLastRxPacket = TimeStep (f.lastRx);
+        s.delaySum = TimeStep (f.delaySum);
+        s.jitterSum = TimeStep (f.jitterSum);
+        s.lastDelay = TimeStep (f.lastDelay);
+        s.txBytes = f.txBytes;
+        s.rxBytes = f.rxBytes;
+        s.txPackets = f.txPackets;
+        s.rxPackets = f.rxPackets;
+        s.lostPackets = f.dropped;
+        s.timesForwarded = f.forwarded;
+      }
+    return stats;
+  }
+
+  /// Five-tuple of a flow id returned by GetFlowStats
+  Ipv4FlowClassifier::FiveTuple FindFlow (FlowId flowId) const
+  {
+    const Flow &f = m_flows.at (flowId - 1);
+    Ipv4FlowClassifier::FiveTuple t;
+    t.sourceAddress = Ipv4Address (static_cast<uint32_t> (f.addrs >> 32));
+    t.destinationAddress = Ipv4Address (static_cast<uint32_t> (f.addrs));
+    t.sourcePort = static_cast<uint16_t> (f.ports >> 24);
+    t.destinationPort = static_cast<uint16_t> (f.ports >> 8);
+    t.protocol = static_cast<uint8_t> (f.ports);
+    return t;
+  }
+
+private:
+  struct Flow
+  {
+    uint64_t addrs;                      //!< source << 32 | destination
+    uint64_t ports;                      //!< source port << 24 | destination port << 8 | protocol
+    uint64_t txBytes = 0;
+    uint64_t rxBytes = 0;
+    uint32_t txPackets = 0;
+    uint32_t rxPackets = 0;
+    uint32_t dropped = 0;
+    uint32_t forwarded = 0;
+    int64_t firstTx = 0;                 //!< all times are Time::GetTimeStep () values
+    int64_t lastTx = 0;
+    int64_t firstRx = 0;
+    int64_t lastRx = 0;
+    int64_t delaySum = 0;
+    int64_t jitterSum = 0;
+    int64_t lastDelay = -1;
+  };
+
+  /// Flow id of the packet, creating the flow on its first packet
+  uint32_t Classify (const Ipv4Header &ip, Ptr<const Packet> payload)
+  {
+    uint8_t ports[4] = { 0, 0, 0, 0 };
+    uint8_t proto = ip.GetProtocol ();
+    if ((proto == 6 || proto == 17) && ip.GetFragmentOffset () == 0)
+      {
+        payload->CopyData (ports, 4);
+      }
+    uint64_t addrs = static_cast<uint64_t> (ip.GetSource ().Get ()) << 32 | ip.GetDestination ().Get ();
+    uint64_t key = static_cast<uint64_t> (ports[0]) << 32 | static_cast<uint64_t> (ports[1]) << 24
+                   | static_cast<uint64_t> (ports[2]) << 16 | static_cast<uint64_t> (ports[3]) << 8 | proto;
+    uint64_t h = (addrs * 0x9e3779b97f4a7c15ull) ^ (key * 0xc2b2ae3d27d4eb4full);
+    for (uint32_t slot = (h ^ (h >> 31)) & m_mask;; slot = (slot + 1) & m_mask)
+      {
+        uint32_t id = m_slots[slot];
+        if (id == 0)
+          {
+            Flow f;
+            f.addrs = addrs;
+            f.ports = key;
+            m_flows.push_back (f);
+            m_slots[slot] = m_flows.size ();
+            if (m_flows.size () * 2 > m_slots.size ())
+              {
+                Grow ();
+              }
+            return m_flows.size ();
+          }
+        if (m_flows[id - 1].addrs == addrs && m_flows[id - 1].ports == key)
+          {
+            return id;
+          }
+      }
+  }
+
+  /// Double the table and reinsert every flow
+  void Grow ()
+  {
+    m_slots.assign (m_slots.size () * 2, 0);
+    m_mask = m_slots.size () - 1;
+    for (uint32_t id = 1; id <= m_flows.size (); ++id)
+      {
+        const Flow &f = m_flows[id - 1];
+        uint64_t h = (f.addrs * 0x9e3779b97f4a7c15ull) ^ (f.ports * 0xc2b2ae3d27d4eb4full);
+        uint32_t slot = (h ^ (h >> 31)) & m_mask;
+        while (m_slots[slot] != 0)
+          {
+            slot = (slot + 1) & m_mask;
+          }
+        m_slots[slot] = id;
+      }
+  }
+
+  void SendOutgoing (const Ipv4Header &ip, Ptr<const Packet> payload, uint32_t interface)
+  {
+    uint32_t id = Classify (ip, payload);
+    Flow &f = m_flows[id - 1];
+    int64_t now = Simulator::Now ().GetTimeStep ();
+    if (f.txPackets == 0)
+      {
+        f.firstTx = now;
+      }
+    f.lastTx = now;
+    f.txPackets++;
+    f.txBytes += payload->GetSize () + ip.GetSerializedSize ();
+    FlatFlowTag tag;
+    tag.flowId = id;
+    tag.txTime = now;
+    payload->AddByteTag (tag);
+  }
+
+  void Forward (const Ipv4Header &ip, Ptr<const Packet> payload, uint32_t interface)
+  {
+    FlatFlowTag tag;
+    if (payload->FindFirstMatchingByteTag (tag))
+      {
+        m_flows[tag.flowId - 1].forwarded++;
+      }
+  }
+
+  void LocalDeliver (const Ipv4Header &ip, Ptr<const Packet> payload, uint32_t interface)
+  {
+    FlatFlowTag tag;
+    if (!payload->FindFirstMatchingByteTag (tag))
+      {
+        return;                          // sent before the monitor was installed
+      }
+    Flow &f = m_flows[tag.flowId - 1];
+    int64_t now = Simulator::Now ().GetTimeStep ();
+    int64_t delay = now - tag.txTime;
+    if (f.rxPackets == 0)
+      {
+        f.firstRx = now;
+      }
+    else if (f.lastDelay >= 0)
+      {
+        f.jitterSum += delay > f.lastDelay ? delay - f.lastDelay : f.lastDelay - delay;
+      }
+    f.lastRx = now;
+    f.lastDelay = delay;
+    f.delaySum += delay;
+    f.rxPackets++;
+    f.rxBytes += payload->GetSize () + ip.GetSerializedSize ();
+  }
+
+  void Drop (const Ipv4Header &ip, Ptr<const Packet> payload, Ipv4L3Protocol::DropReason reason,
+             Ptr<Ipv4> ipv4, uint32_t interface)
+  {
+    FlatFlowTag tag;
+    if (payload->FindFirstMatchingByteTag (tag))
+      {
+        m_flows[tag.flowId - 1].dropped++;
+      }
+  }
+
+  /// Device transmit queue drop; the packet still carries the tag of its payload bytes
+  void QueueDrop (Ptr<const Packet> packet)
+  {
+    FlatFlowTag tag;
+    if (packet->FindFirstMatchingByteTag (tag))
+      {
+        m_flows[tag.flowId - 1].dropped++;
+      }
+  }
+
+  void QueueDiscDrop (Ptr<const QueueDiscItem> item)
+  {
+    QueueDrop (item->GetPacket ());
+  }
+
+  uint32_t m_mask;
+  std::vector<uint32_t> m_slots;         //!< flow id per slot, 0 = empty
+  std::vector<Flow> m_flows;             //!< stats of flow id at [id - 1]
+};
+
+NS_OBJECT_ENSURE_REGISTERED (FlatFlowTag);
+
+} // namespace ns3
+
+#endif /* FLAT_FLOW_MONITOR_H */
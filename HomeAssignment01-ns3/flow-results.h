@@ -0,0 +1,173 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Compact binary, column oriented per-flow results of one run.
+ *
+ * One row per flow with the FlowMonitor counters and timestamps, and
+ * optionally the delay, jitter and packet size histograms as fixed width
+ * count columns. Every column is a contiguous little-endian array, so
+ * flow_results.py can memory-map a column without parsing the file:
+ *
+ *   char     magic[8]      "NS3FLOW1"
+ *   uint32   columns, rows
+ *   columns x { char name[32]; char dtype[4]; uint32 width; uint64 offset; }
+ *   column data at offset (8-byte aligned): rows x max (width, 1) values of dtype
+ *
+ * dtype is a numpy type string ("<u2", "<u4", "<u8", "<f8"). width is 0 for
+ * plain columns and the number of bins for histogram columns, whose rows
+ * are bin counts padded with zeros to the widest histogram of the run;
+ * <name>BinWidth gives the bin width. Times are in seconds.
+ *
+ * Copy this header next to the script in scratch/ to use it.
+ */
+
+#ifndef FLOW_RESULTS_H
+#define FLOW_RESULTS_H
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "ns3/fatal-error.h"
+#include "ns3/flow-monitor.h"
+#include "ns3/ipv4-flow-classifier.h"
+
+namespace ns3 {
+
+class FlowResultsWriter
+{
+public:
+  /// Collect the current stats of every flow of monitor
+  FlowResultsWriter (Ptr<FlowMonitor> monitor, Ptr<Ipv4FlowClassifier> classifier, bool histograms = false)
+  {
+    const FlowMonitor::FlowStatsContainer &stats = monitor->GetFlowStats ();
+    m_rows = stats.size ();
+    for (FlowMonitor::FlowStatsContainer::const_iterator i = stats.begin (); i != stats.end (); ++i)
+      {
+        const FlowMonitor::FlowStats &s = i->second;
+        Ipv4FlowClassifier::FiveTuple t = classifier->FindFlow (i->first);
+        Push<uint32_t> ("flowId", "<u4", i->first);
+        Push<uint32_t> ("srcAddr", "<u4", t.sourceAddress.Get ());
+        Push<uint32_t> ("dstAddr", "<u4", t.destinationAddress.Get ());
+        Push<uint16_t> ("srcPort", "<u2", t.sourcePort);
+        Push<uint16_t> ("dstPort", "<u2", t.destinationPort);
+        Push<uint16_t> ("protocol", "<u2", t.protocol);
+        Push<uint64_t> ("txBytes", "<u8", s.txBytes);
+        Push<uint64_t> ("rxBytes", "<u8", s.rxBytes);
+        Push<uint64_t> ("txPackets", "<u8", s.txPackets);
+        Push<uint64_t> ("rxPackets", "<u8", s.rxPackets);
+        Push<uint64_t> ("lostPackets", "<u8", s.lostPackets);
+        Push<uint64_t> ("timesForwarded", "<u8", s.timesForwarded);
+        Push<double> ("timeFirstTxPacket", "<f8", s.timeFirstTxPacket.GetSeconds ());
+        Push<double> ("timeLastTxPacket", "<f8", s.timeLastTxPacket.GetSeconds ());
+        Push<double> ("timeFirstRxPacket", "<f8", s.timeFirstRxPacket.GetSeconds ());
+        Push<double> ("timeLastRxPacket", "<f8", s.timeLastRxPacket.GetSeconds ());
+        Push<double> ("delaySum", "<f8", s.delaySum.GetSeconds ());
+        Push<double> ("jitterSum", "<f8", s.jitterSum.GetSeconds ());
+      }
+    if (histograms)
+      {
+        AddHistogram (stats, "delayHistogram", &FlowMonitor::FlowStats::delayHistogram);
+        AddHistogram (stats, "jitterHistogram", &FlowMonitor::FlowStats::jitterHistogram);
+        AddHistogram (stats, "packetSizeHistogram", &FlowMonitor::FlowStats::packetSizeHistogram);
+      }
+  }
+
+  void Write (std::string fileName) const
+  {
+    std::ofstream out (fileName.c_str (), std::ios::binary);
+    if (!out)
+      {
+        NS_FATAL_ERROR ("cannot open " << fileName);
+      }
+    uint32_t header[2] = { static_cast<uint32_t> (m_columns.size ()), m_rows };
+    out.write ("NS3FLOW1", 8);
+    out.write (reinterpret_cast<const char *> (header), sizeof (header));
+    uint64_t offset = Align (16 + m_columns.size () * 48);
+    for (size_t c = 0; c < m_columns.size (); ++c)
+      {
+        char name[32] = { 0 };
+        char dtype[4] = { 0 };
+        std::strncpy (name, m_columns[c].name.c_str (), sizeof (name) - 1);
+        std::strncpy (dtype, m_columns[c].dtype.c_str (), sizeof (dtype));
+        out.write (name, sizeof (name));
+        out.write (dtype, sizeof (dtype));
+        out.write (reinterpret_cast<const char *> (&m_columns[c].width), 4);
+        out.write (reinterpret_cast<const char *> (&offset), 8);
+        offset = Align (offset + m_columns[c].data.size ());
+      }
+    static const char zeros[8] = { 0 };
+    for (size_t c = 0; c < m_columns.size (); ++c)
+      {
+        out.write (zeros, Align (out.tellp ()) - static_cast<uint64_t> (out.tellp ()));
+        out.write (m_columns[c].data.data (), m_columns[c].data.size ());
+      }
+  }
+
+private:
+  struct Column
+  {
+    std::string name;
+    std::string dtype;
+    uint32_t width;
+    std::vector<char> data;
+  };
+
+  static uint64_t Align (uint64_t offset)
+  {
+    return (offset + 7) & ~static_cast<uint64_t> (7);
+  }
+
+  Column &Find (const std::string &name, const std::string &dtype, uint32_t width)
+  {
+    for (size_t c = 0; c < m_columns.size (); ++c)
+      {
+        if (m_columns[c].name == name)
+          {
+            return m_columns[c];
+          }
+      }
+    Column column = { name, dtype, width, std::vector<char> () };
+    m_columns.push_back (column);
+    return m_columns.back ();
+  }
+
+  template <typename T>
+  void Push (const std::string &name, const std::string &dtype, T value)
+  {
+    std::vector<char> &data = Find (name, dtype, 0).data;
+    const char *p = reinterpret_cast<const char *> (&value);
+    data.insert (data.end (), p, p + sizeof (T));
+  }
+
+  /// Bin counts of one histogram of every flow, zero padded to the widest one
+  void AddHistogram (const FlowMonitor::FlowStatsContainer &stats, const std::string &name,
+                     Histogram FlowMonitor::FlowStats::*member)
+  {
+    uint32_t bins = 1;
+    for (FlowMonitor::FlowStatsContainer::const_iterator i = stats.begin (); i != stats.end (); ++i)
+      {
+        bins = std::max (bins, (i->second.*member).GetNBins ());
+      }
+    std::vector<uint32_t> counts;
+    counts.reserve (static_cast<size_t> (bins) * stats.size ());
+    for (FlowMonitor::FlowStatsContainer::const_iterator i = stats.begin (); i != stats.end (); ++i)
+      {
+        const Histogram &h = i->second.*member;
+        for (uint32_t b = 0; b < bins; ++b)
+          {
+            counts.push_back (b < h.GetNBins () ? h.GetBinCount (b) : 0);
+          }
+        Push<double> (name + "BinWidth", "<f8", h.GetNBins () > 0 ? h.GetBinWidth (0) : 0.0);
+      }
+    const char *p = reinterpret_cast<const char *> (counts.data ());
+    Find (name, "<u4", bins).data.assign (p, p + counts.size () * sizeof (uint32_t));
+  }
+
+  uint32_t m_rows;
+  std::vector<Column> m_columns;
+};
+
+} // namespace ns3
+
+#endif /* FLOW_RESULTS_H */
@@ -0,0 +1,98 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Periodic per-flow statistics sampler on top of FlowMonitor.
+ *
+ * Every interval the cumulative FlowStats of each flow are compared with the
+ * previous sample and one line per flow is appended to a CSV file:
+ *
+ *   time,flowId,rxMbps,txMbps,meanDelay,rxPackets,lostPackets
+ *
+ * Only the last snapshot of every flow is kept, so memory depends on the
+ * number of flows and not on the length of the run. Lines are streamed to
+ * disk as they are produced.
+ *
+ * Copy this header next to the script in scratch/ to use it.
+ */
+
+#ifndef FLOW_SAMPLER_H
+#define FLOW_SAMPLER_H
+
+#include <fstream>
+#include <map>
+#include <string>
+#include "ns3/simulator.h"
+#include "ns3/nstime.h"
+#include "ns3/flow-monitor.h"
+
+namespace ns3 {
+
+class FlowSampler
+{
+public:
+  FlowSampler (Ptr<FlowMonitor> monitor, Time interval, std::string fileName)
+    : m_monitor (monitor),
+      m_interval (interval),
+      m_out (fileName.c_str ())
+  {
+    m_out << "time,flowId,rxMbps,txMbps,meanDelay,rxPackets,lostPackets\n";
+  }
+
+  /**
+   * Count from start (call before Simulator::Run): the first sample is taken
+   * at start + interval, covering [start, start + interval], and then every
+   * interval until the simulation stops.
+   */
+  void Start (Time start)
+  {
+    m_last = start;
+    Simulator::Schedule (start + m_interval, &FlowSampler::Sample, this);
+  }
+
+private:
+  /// Counters of a flow at the previous sample
+  struct Snapshot
+  {
+    uint64_t txBytes = 0;
+    uint64_t rxBytes = 0;
+    uint32_t rxPackets = 0;
+    uint32_t lostPackets = 0;
+    Time delaySum;
+  };
+
+  void Sample ()
+  {
+    Time now = Simulator::Now ();
+    double dt = (now - m_last).GetSeconds ();
+    m_monitor->CheckForLostPackets ();
+    const FlowMonitor::FlowStatsContainer &stats = m_monitor->GetFlowStats ();
+    for (FlowMonitor::FlowStatsContainer::const_iterator i = stats.begin (); i != stats.end (); ++i)
+      {
+        Snapshot &prev = m_prev[i->first];
+        uint32_t rxPackets = i->second.rxPackets - prev.rxPackets;
+        double meanDelay = rxPackets ? (i->second.delaySum - prev.delaySum).GetSeconds () / rxPackets : 0.0;
+        m_out << now.GetSeconds () << ',' << i->first << ','
+              << (i->second.rxBytes - prev.rxBytes) * 8.0 / dt / 1e6 << ','
+              << (i->second.txBytes - prev.txBytes) * 8.0 / dt / 1e6 << ','
+              << meanDelay << ',' << rxPackets << ','
+              << i->second.lostPackets - prev.lostPackets << '\n';
+        prev.txBytes = i->second.txBytes;
+        prev.rxBytes = i->second.rxBytes;
+        prev.rxPackets = i->second.rxPackets;
+        prev.lostPackets = i->second.lostPackets;
+        prev.delaySum = i->second.delaySum;
+      }
+    m_out.flush ();
+    m_last = now;
+    Simulator::Schedule (m_interval, &FlowSampler::Sample, this);
+  }
+
+  Ptr<FlowMonitor> m_monitor;
+  Time m_interval;
+  Time m_last;
+  std::ofstream m_out;
+  std::map<FlowId, Snapshot> m_prev;
+};
+
+} // namespace ns3
+
+#endif /* FLOW_SAMPLER_H */
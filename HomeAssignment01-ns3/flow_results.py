@@ -0,0 +1,72 @@
+"""Loader for the binary per-flow results written by flow-results.h
+
+Every column is memory-mapped, so opening a file only reads its small
+directory, and a column is only read from disk when it is used.
+
+    from flow_results import load, load_many
+    flows = load("data.flowres")
+    tput = flows["rxBytes"] * 8 / (flows["timeLastRxPacket"] - flows["timeFirstTxPacket"]) / 1e6
+    runs = load_many(glob.glob("sweep-runs/*/data.flowres"))   # adds a "run" column
+"""
+
+import struct
+
+import numpy as np
+
+MAGIC = b"NS3FLOW1"
+ENTRY = struct.Struct("<32s4sIQ")
+
+
+def columns(path):
+    """(name, dtype, width, offset) of every column, and the number of rows."""
+    with open(path, "rb") as f:
+        head = f.read(16)
+        if head[:8] != MAGIC:
+            raise ValueError("%s is not a flow results file" % path)
+        ncols, rows = struct.unpack("<II", head[8:])
+        directory = f.read(ncols * ENTRY.size)
+    out = []
+    for c in range(ncols):
+        name, dtype, width, offset = ENTRY.unpack_from(directory, c * ENTRY.size)
+        out.append((name.rstrip(b"\0").decode(), dtype.rstrip(b"\0").decode(), width, offset))
+    return out, rows
+
+
+def load(path):
+    """Dict of column name -> read-only memory-mapped array (2-D for histograms)."""
+    cols, rows = columns(path)
+    result = {}
+    for name, dtype, width, offset in cols:
+        shape = (rows,) if width == 0 else (rows, width)
+        if rows == 0:
+            result[name] = np.zeros(shape, dtype=dtype)
+        else:
+            result[name] = np.memmap(path, dtype=dtype, mode="r", offset=offset, shape=shape)
+    return result
+
+
+def load_many(paths):
+    """Concatenate the flows of many runs; "run" is the index of the file in paths.
+
+    Histogram columns of different widths are zero padded to the widest run.
+    """
+    tables = [load(p) for p in paths]
+    sizes = [len(t["flowId"]) if "flowId" in t else 0 for t in tables]
+    result = {"run": np.repeat(np.arange(len(tables), dtype=np.uint32), sizes)}
+    names = []
+    for t in tables:
+        names += [name for name in t if name not in names]
+    for name in names:
+        like = next(t[name] for t in tables if name in t)
+        width = max(t[name].shape[1] for t in tables if name in t) if like.ndim == 2 else None
+        parts = []
+        for t, n in zip(tables, sizes):
+            part = t.get(name)
+            if part is None:
+                # Runs written without this column (e.g. without histograms) get zeros
+                part = np.zeros((n, width) if width else n, dtype=like.dtype)
+            elif width:
+                part = np.pad(part, ((0, 0), (0, width - part.shape[1])))
+            parts.append(part)
+        result[name] = np.concatenate(parts)
+    return result
@@ -0,0 +1,71 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Run several variants of one scenario from a single setup.
+ *
+ * Building nodes, devices, the internet stack, addresses and applications
+ * is the same for every variant of an experiment (RTS/CTS on or off, a
+ * different rate, ...). Instead of rebuilding it per variant, the script
+ * builds it once, up to t=0 before Simulator::Run, and ForkVariants forks
+ * one child per variant from that state. Each child applies its variant
+ * (Config::Set on the already created objects), runs and exits; the parent
+ * keeps the untouched t=0 state for the next variant. Children run one
+ * after another, so their output is in variant order.
+ *
+ * Nothing may be opened for writing before the fork (pcap files, sample
+ * files), otherwise all children write into the same file.
+ *
+ * Copy this header next to the script in scratch/ to use it.
+ */
+
+#ifndef FORK_VARIANTS_H
+#define FORK_VARIANTS_H
+
+#include <cstdio>
+#include <iostream>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "ns3/fatal-error.h"
+
+namespace ns3 {
+
+/**
+ * Call run (i) for i = 0 .. count-1, each in a child process forked from the
+ * current state. Returns the number of children that did not exit cleanly.
+ */
+template <typename Run>
+uint32_t
+ForkVariants (uint32_t count, Run run)
+{
+  uint32_t failed = 0;
+  for (uint32_t i = 0; i < count; ++i)
+    {
+      // Anything still buffered would be printed again by the child
+      std::cout.flush ();
+      std::fflush (0);
+      pid_t pid = fork ();
+      if (pid < 0)
+        {
+          NS_FATAL_ERROR ("fork failed for variant " << i);
+        }
+      if (pid == 0)
+        {
+          run (i);
+          std::cout.flush ();
+          std::fflush (0);
+          // Skip the parent's static destructors and atexit handlers
+          _exit (0);
+        }
+      int status = 0;
+      if (waitpid (pid, &status, 0) != pid || !WIFEXITED (status) || WEXITSTATUS (status) != 0)
+        {
+          std::cerr << "variant " << i << " failed\n";
+          failed++;
+        }
+    }
+  return failed;
+}
+
+} // namespace ns3
+
+#endif /* FORK_VARIANTS_H */
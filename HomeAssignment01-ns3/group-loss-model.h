@@ -0,0 +1,140 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Propagation loss by collision-domain group.
+ *
+ * MatrixPropagationLossModel keeps a std::map keyed on pairs of mobility
+ * model pointers, so every reception does an ordered-map lookup and the
+ * table grows with N^2 for dense setups. Here every node is assigned to a
+ * group and the loss is stored in a flat groups x groups table, so a lookup
+ * is two vector reads and memory grows with the number of groups.
+ *
+ *  - full clique: no groups, only SetDefaultLoss (50)
+ *  - hidden terminals: hub in group 0, stations in group 1,
+ *    SetLoss (0, 1, 50) and SetLoss (1, 1, 200)
+ *
+ * Copy this header next to the script in scratch/ to use it.
+ */
+
+#ifndef GROUP_LOSS_MODEL_H
+#define GROUP_LOSS_MODEL_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "ns3/double.h"
+#include "ns3/mobility-model.h"
+#include "ns3/node.h"
+#include "ns3/propagation-loss-model.h"
+
+namespace ns3 {
+
+class GroupPropagationLossModel : public PropagationLossModel
+{
+public:
+  static TypeId GetTypeId (void)
+  {
+    static TypeId tid = TypeId ("ns3::GroupPropagationLossModel")
+      .SetParent<PropagationLossModel> ()
+      .SetGroupName ("Propagation")
+      .AddConstructor<GroupPropagationLossModel> ()
+      .AddAttribute ("DefaultLoss", "The default value for propagation loss, dB.",
+                     DoubleValue (std::numeric_limits<double>::max ()),
+                     MakeDoubleAccessor (&GroupPropagationLossModel::m_default),
+                     MakeDoubleChecker<double> ())
+    ;
+    return tid;
+  }
+
+  GroupPropagationLossModel ()
+    : m_groups (0),
+      m_default (std::numeric_limits<double>::max ())
+  {
+  }
+
+  /// Put the node with the given id into group (groups are numbered from 0)
+  void SetNodeGroup (uint32_t nodeId, uint32_t group)
+  {
+    if (nodeId >= m_groupOf.size ())
+      {
+        m_groupOf.resize (nodeId + 1, static_cast<uint32_t> (NO_GROUP));
+      }
+    m_groupOf[nodeId] = group;
+    if (group >= m_groups)
+      {
+        Resize (group + 1);
+      }
+  }
+
+  /// Set loss in dB between members of groups a and b (a == b: within a group)
+  void SetLoss (uint32_t a, uint32_t b, double loss, bool symmetric = true)
+  {
+    if (std::max (a, b) >= m_groups)
+      {
+        Resize (std::max (a, b) + 1);
+      }
+    m_loss[a * m_groups + b] = loss;
+    if (symmetric)
+      {
+        m_loss[b * m_groups + a] = loss;
+      }
+  }
+
+  /// Loss used for ungrouped nodes and for group pairs without an explicit SetLoss
+  void SetDefaultLoss (double loss)
+  {
+    m_default = loss;
+  }
+
+private:
+  enum { NO_GROUP = 0xffffffff };
+
+  virtual double DoCalcRxPower (double txPowerDbm, Ptr<MobilityModel> a, Ptr<MobilityModel> b) const
+  {
+    uint32_t ga = GroupOf (a);
+    uint32_t gb = GroupOf (b);
+    if (ga == NO_GROUP || gb == NO_GROUP)
+      {
+        return txPowerDbm - m_default;
+      }
+    double loss = m_loss[ga * m_groups + gb];
+    return txPowerDbm - (std::isnan (loss) ? m_default : loss);
+  }
+
+  virtual int64_t DoAssignStreams (int64_t stream)
+  {
+    return 0;
+  }
+
+  uint32_t GroupOf (Ptr<MobilityModel> mobility) const
+  {
+    uint32_t id = mobility->GetObject<Node> ()->GetId ();
+    return id < m_groupOf.size () ? m_groupOf[id] : NO_GROUP;
+  }
+
+  /// Grow the table to groups x groups, keeping the entries already set
+  void Resize (uint32_t groups)
+  {
+    std::vector<double> loss (groups * groups, std::numeric_limits<double>::quiet_NaN ());
+    for (uint32_t i = 0; i < m_groups; ++i)
+      {
+        for (uint32_t j = 0; j < m_groups; ++j)
+          {
+            loss[i * groups + j] = m_loss[i * m_groups + j];
+          }
+      }
+    m_loss.swap (loss);
+    m_groups = groups;
+  }
+
+  std::vector<uint32_t> m_groupOf; //!< group of each node, indexed by node id
+  std::vector<double> m_loss;      //!< m_groups x m_groups, NaN = default
+  uint32_t m_groups;
+  double m_default;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (GroupPropagationLossModel);
+
+} // namespace ns3
+
+#endif /* GROUP_LOSS_MODEL_H */
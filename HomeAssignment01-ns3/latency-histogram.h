@@ -0,0 +1,277 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Tail latency of application flows with fixed-size, log-bucketed
+ * (HDR-style) histograms.
+ *
+ * A source application's "Tx" trace stamps every packet with the send time
+ * and the flow index; the receiving node's LocalDeliver trace reads the
+ * stamp back and records the one-way delay. No receiving socket is needed,
+ * so this also works for CBR flows without a PacketSink.
+ *
+ * Delays are recorded in nanoseconds. Values below 128 ns get one bucket
+ * each; above that every power of two is split into 64 linear sub-buckets,
+ * so a reported percentile is within 1/128 of the true value. Recording is
+ * a count leading zeros, a shift and an increment; the histogram is a
+ * fixed array of 2240 counts covering up to about 18 minutes.
+ *
+ * Copy this header next to the script in scratch/ to use it.
+ */
+
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+#include "ns3/application.h"
+#include "ns3/callback.h"
+#include "ns3/ipv4-l3-protocol.h"
+#include "ns3/node.h"
+#include "ns3/packet.h"
+#include "ns3/simulator.h"
+#include "ns3/tag.h"
+
+namespace ns3 {
+
+class LatencyHistogram
+{
+public:
+  enum
+  {
+    SUB_BITS = 6,                        //!< 64 sub-buckets per power of two
+    MAX_BITS = 40,                       //!< values up to 2^40 ns
+    BUCKETS = (2 << SUB_BITS) + (MAX_BITS - SUB_BITS - 1) * (1 << SUB_BITS)
+  };
+
+  LatencyHistogram ()
+  {
+    Reset ();
+  }
+
+  void Reset ()
+  {
+    std::fill (m_counts, m_counts + BUCKETS, 0);
+    m_count = 0;
+    m_min = 0;
+    m_max = 0;
+  }
+
+  void Record (uint64_t ns)
+  {
+    m_counts[Index (ns)]++;
+    m_min = m_count == 0 || ns < m_min ? ns : m_min;
+    m_max = ns > m_max ? ns : m_max;
+    m_count++;
+  }
+
+  void Add (const LatencyHistogram &other)
+  {
+    for (uint32_t i = 0; i < BUCKETS; ++i)
+      {
+        m_counts[i] += other.m_counts[i];
+      }
+    if (other.m_count > 0)
+      {
+        m_min = m_count == 0 || other.m_min < m_min ? other.m_min : m_min;
+        m_max = other.m_max > m_max ? other.m_max : m_max;
+      }
+    m_count += other.m_count;
+  }
+
+  uint64_t GetCount () const
+  {
+    return m_count;
+  }
+
+  /// Value below which a fraction q of the recorded delays lie (middle of its bucket)
+  Time GetPercentile (double q) const
+  {
+    if (m_count == 0)
+      {
+        return Time (0);
+      }
+    uint64_t rank = static_cast<uint64_t> (std::ceil (q * m_count));
+    rank = rank < 1 ? 1 : rank;
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < BUCKETS; ++i)
+      {
+        seen += m_counts[i];
+        if (seen >= rank)
+          {
+            uint64_t v = Middle (i);
+            v = v < m_min ? m_min : v;
+            return NanoSeconds (v > m_max ? m_max : v);
+          }
+      }
+    return NanoSeconds (m_max);
+  }
+
+  Time GetMin () const
+  {
+    return NanoSeconds (m_min);
+  }
+
+  Time GetMax () const
+  {
+    return NanoSeconds (m_max);
+  }
+
+private:
+  static uint32_t Index (uint64_t ns)
+  {
+    if (ns < (2u << SUB_BITS))
+      {
+        return ns;
+      }
+    if (ns >> MAX_BITS)
+      {
+        return BUCKETS - 1;
+      }
+    uint32_t shift = 63 - __builtin_clzll (ns) - SUB_BITS;
+    return (2u << SUB_BITS) + (shift - 1) * (1u << SUB_BITS) + (ns >> shift) - (1u << SUB_BITS);
+  }
+
+  static uint64_t Middle (uint32_t index)
+  {
+    if (index < (2u << SUB_BITS))
+      {
+        return index;
+      }
+    uint32_t shift = (index - (2u << SUB_BITS)) / (1u << SUB_BITS) + 1;
+    uint64_t low = static_cast<uint64_t> ((index - (2u << SUB_BITS)) % (1u << SUB_BITS) + (1u << SUB_BITS)) << shift;
+    return low + (static_cast<uint64_t> (1) << (shift - 1));
+  }
+
+  uint64_t m_counts[BUCKETS];
+  uint64_t m_count;
+  uint64_t m_min;
+  uint64_t m_max;
+};
+
+/// Send time and flow index stamped on the packets of watched sources
+class LatencyTag : public Tag
+{
+public:
+  static TypeId GetTypeId (void)
+  {
+    static TypeId tid = TypeId ("ns3::LatencyTag")
+      .SetParent<Tag> ()
+      .AddConstructor<LatencyTag> ()
+    ;
+    return tid;
+  }
+  virtual TypeId GetInstanceTypeId (void) const
+  {
+    return GetTypeId ();
+  }
+  virtual uint32_t GetSerializedSize (void) const
+  {
+    return 4 + 8;
+  }
+  virtual void Serialize (TagBuffer buf) const
+  {
+    buf.WriteU32 (flow);
+    buf.WriteU64 (static_cast<uint64_t> (txTime));
+  }
+  virtual void Deserialize (TagBuffer buf)
+  {
+    flow = buf.ReadU32 ();
+    txTime = static_cast<int64_t> (buf.ReadU64 ());
+  }
+  virtual void Print (std::ostream &os) const
+  {
+    os << "Flow=" << flow << " TxTime=" << txTime;
+  }
+
+  uint32_t flow = 0;
+  int64_t txTime = 0;                    //!< Time::GetTimeStep () at the source
+};
+
+class LatencyRecorder
+{
+public:
+  /**
+   * Record the delay of every packet source sends until it is delivered at
+   * receiver. source must have a "Tx" trace with a Ptr<const Packet>
+   * argument (OnOffApplication, BulkSendApplication, ...).
+   */
+  void Watch (Ptr<Application> source, Ptr<Node> receiver, std::string label)
+  {
+    Flow flow;
+    flow.label = label;
+    m_flows.push_back (flow);
+    source->TraceConnectWithoutContext ("Tx", MakeBoundCallback (&LatencyRecorder::Sent,
+                                                                 static_cast<uint32_t> (m_flows.size () - 1)));
+    if (m_receivers.insert (receiver->GetId ()).second)
+      {
+        receiver->GetObject<Ipv4L3Protocol> ()->TraceConnectWithoutContext (
+          "LocalDeliver", MakeCallback (&LatencyRecorder::Delivered, this));
+      }
+  }
+
+  /// p50/p99/p99.9/max of every flow in milliseconds, and of all flows together if there are several
+  void Report (std::ostream &os) const
+  {
+    LatencyHistogram all;
+    for (size_t i = 0; i < m_flows.size (); ++i)
+      {
+        Print (os, m_flows[i].label, m_flows[i].histogram);
+        all.Add (m_flows[i].histogram);
+      }
+    if (m_flows.size () > 1)
+      {
+        Print (os, "all flows", all);
+      }
+  }
+
+  const LatencyHistogram &GetHistogram (uint32_t flow) const
+  {
+    return m_flows.at (flow).histogram;
+  }
+
+private:
+  struct Flow
+  {
+    std::string label;
+    LatencyHistogram histogram;
+  };
+
+  static void Sent (uint32_t flow, Ptr<const Packet> packet)
+  {
+    LatencyTag tag;
+    tag.flow = flow;
+    tag.txTime = Simulator::Now ().GetTimeStep ();
+    packet->AddByteTag (tag);
+  }
+
+  void Delivered (const Ipv4Header &ip, Ptr<const Packet> packet, uint32_t interface)
+  {
+    LatencyTag tag;
+    if (packet->FindFirstMatchingByteTag (tag) && tag.flow < m_flows.size ())
+      {
+        Time delay = Simulator::Now () - TimeStep (tag.txTime);
+        m_flows[tag.flow].histogram.Record (delay.GetNanoSeconds ());
+      }
+  }
+
+  static void Print (std::ostream &os, const std::string &label, const LatencyHistogram &h)
+  {
+    os << "Latency " << label << ": p50 = " << h.GetPercentile (0.5).GetSeconds () * 1e3
+       << " ms, p99 = " << h.GetPercentile (0.99).GetSeconds () * 1e3
+       << " ms, p99.9 = " << h.GetPercentile (0.999).GetSeconds () * 1e3
+       << " ms, max = " << h.GetMax ().GetSeconds () * 1e3
+       << " ms (" << h.GetCount () << " packets)" << std::endl;
+  }
+
+  std::vector<Flow> m_flows;
+  std::set<uint32_t> m_receivers;
+};
+
+NS_OBJECT_ENSURE_REGISTERED (LatencyTag);
+
+} // namespace ns3
+
+#endif /* LATENCY_HISTOGRAM_H */
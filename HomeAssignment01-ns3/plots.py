@@ -1,3 +1,4 @@
+import sys
 import matplotlib.pyplot as plt
 
 data_rate = [0, 4, 8, 12, 16, 20, 24, 28, 32, 36, 40, 44, 48, 52]
@@ -18,4 +19,21 @@ plt.xlabel("Sender Window Size (bytes)")
 plt.ylabel("Throughput (Mbps)")
 plt.title("Single-flow FTP Throughput vs Sender Window Size")
 plt.plot(window_size, thpt)
-plt.savefig("single_flow_ftp.png")
\ No newline at end of file
+plt.savefig("single_flow_ftp.png")
+
+# Per-flow results of any number of runs (resultsFile of the Lab 01 scripts), e.g.
+#   python3 plots.py sweep-runs/*/data.flowres
+if len(sys.argv) > 1:
+    import numpy as np
+    from flow_results import load_many
+
+    flows = load_many(sys.argv[1:])
+    duration = flows["timeLastRxPacket"] - flows["timeFirstTxPacket"]
+    tput = flows["rxBytes"] * 8.0 / np.where(duration > 0, duration, np.nan) / 1e6
+
+    plt.figure()
+    plt.xlabel("Run")
+    plt.ylabel("Throughput (Mbps)")
+    plt.title("Per-flow Throughput of each Run")
+    plt.scatter(flows["run"], tput, s=4)
+    plt.savefig("flow_results.png")
@@ -0,0 +1,178 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Sampled queue occupancy and drop trace of point-to-point devices.
+ *
+ * For every added device both the device queue (the DropTail queue sized by
+ * ns3::QueueBase::MaxSize) and the root queue disc the traffic control layer
+ * put in front of it are watched. Their depth is sampled every interval and
+ * every drop is recorded with the depth at that moment. Records go into a
+ * ring buffer allocated up front, which is written out in one piece when it
+ * is full and by Close, so tracing costs no allocation or formatting per
+ * event:
+ *
+ *   char    magic[8]       "NS3QTRC1"
+ *   uint32  recordSize     24
+ *   uint32  reserved
+ *   records { int64 time (ns); uint32 packets; uint32 bytes; uint16 device;
+ *             uint8 queue (0 device queue, 1 queue disc); uint8 event
+ *             (0 sample, 1 drop); uint32 reserved }
+ *
+ * which numpy reads with
+ *
+ *   np.fromfile (f, offset=16, dtype=[("time", "<i8"), ("packets", "<u4"), ("bytes", "<u4"),
+ *                ("device", "<u2"), ("queue", "u1"), ("event", "u1"), ("pad", "<u4")])
+ *
+ * Copy this header next to the script in scratch/ to use it.
+ */
+
+#ifndef QUEUE_TRACE_H
+#define QUEUE_TRACE_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include "ns3/fatal-error.h"
+#include "ns3/simulator.h"
+#include "ns3/nstime.h"
+#include "ns3/point-to-point-net-device.h"
+#include "ns3/queue.h"
+#include "ns3/queue-disc.h"
+#include "ns3/traffic-control-layer.h"
+
+namespace ns3 {
+
+class QueueTracer
+{
+public:
+  QueueTracer (std::string fileName, Time interval, uint32_t capacity = 65536)
+    : m_interval (interval),
+      m_records (capacity < 1 ? 1 : capacity),
+      m_used (0),
+      m_out (fileName.c_str (), std::ios::binary)
+  {
+    if (!m_out)
+      {
+        NS_FATAL_ERROR ("cannot open " << fileName);
+      }
+    uint32_t header[2] = { sizeof (Record), 0 };
+    m_out.write ("NS3QTRC1", 8);
+    m_out.write (reinterpret_cast<const char *> (header), sizeof (header));
+  }
+
+  ~QueueTracer ()
+  {
+    Close ();
+  }
+
+  /// Watch the queue and root queue disc of device; returns its device number in the trace
+  uint16_t Add (Ptr<PointToPointNetDevice> device)
+  {
+    Watched w;
+    w.queue = device->GetQueue ();
+    Ptr<TrafficControlLayer> tc = device->GetNode ()->GetObject<TrafficControlLayer> ();
+    if (tc)
+      {
+        w.disc = tc->GetRootQueueDiscOnDevice (device);
+      }
+    uint16_t index = m_watched.size ();
+    m_watched.push_back (w);
+    w.queue->TraceConnectWithoutContext ("Drop", MakeBoundCallback (&QueueTracer::QueueDrop, this, index));
+    if (w.disc)
+      {
+        w.disc->TraceConnectWithoutContext ("Drop", MakeBoundCallback (&QueueTracer::DiscDrop, this, index));
+      }
+    return index;
+  }
+
+  /// Take the first sample at start and then every interval until the simulation stops
+  void Start (Time start)
+  {
+    Simulator::Schedule (start, &QueueTracer::Sample, this);
+  }
+
+  /// Write out the records still in the buffer
+  void Close ()
+  {
+    if (m_out.is_open ())
+      {
+        Flush ();
+        m_out.close ();
+      }
+  }
+
+private:
+  struct Record
+  {
+    int64_t time;
+    uint32_t packets;
+    uint32_t bytes;
+    uint16_t device;
+    uint8_t queue;
+    uint8_t event;
+    uint32_t reserved;
+  };
+
+  struct Watched
+  {
+    Ptr<Queue<Packet> > queue;
+    Ptr<QueueDisc> disc;
+  };
+
+  void Push (uint16_t device, uint8_t queue, uint8_t event, uint32_t packets, uint32_t bytes)
+  {
+    Record &r = m_records[m_used];
+    r.time = Simulator::Now ().GetNanoSeconds ();
+    r.packets = packets;
+    r.bytes = bytes;
+    r.device = device;
+    r.queue = queue;
+    r.event = event;
+    r.reserved = 0;
+    if (++m_used == m_records.size ())
+      {
+        Flush ();
+      }
+  }
+
+  void Flush ()
+  {
+    m_out.write (reinterpret_cast<const char *> (m_records.data ()), m_used * sizeof (Record));
+    m_used = 0;
+  }
+
+  void Sample ()
+  {
+    for (uint16_t i = 0; i < m_watched.size (); ++i)
+      {
+        const Watched &w = m_watched[i];
+        Push (i, 0, 0, w.queue->GetNPackets (), w.queue->GetNBytes ());
+        if (w.disc)
+          {
+            Push (i, 1, 0, w.disc->GetNPackets (), w.disc->GetNBytes ());
+          }
+      }
+    Simulator::Schedule (m_interval, &QueueTracer::Sample, this);
+  }
+
+  static void QueueDrop (QueueTracer *tracer, uint16_t device, Ptr<const Packet> packet)
+  {
+    const Watched &w = tracer->m_watched[device];
+    tracer->Push (device, 0, 1, w.queue->GetNPackets (), w.queue->GetNBytes ());
+  }
+
+  static void DiscDrop (QueueTracer *tracer, uint16_t device, Ptr<const QueueDiscItem> item)
+  {
+    const Watched &w = tracer->m_watched[device];
+    tracer->Push (device, 1, 1, w.disc->GetNPackets (), w.disc->GetNBytes ());
+  }
+
+  Time m_interval;
+  std::vector<Record> m_records;         //!< preallocated ring, m_used of them filled
+  uint32_t m_used;
+  std::vector<Watched> m_watched;
+  std::ofstream m_out;
+};
+
+} // namespace ns3
+
+#endif /* QUEUE_TRACE_H */
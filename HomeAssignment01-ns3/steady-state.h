@@ -0,0 +1,178 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Online steady-state detector: ends the simulation once the throughput of
+ * the watched flows has settled.
+ *
+ * Every batch interval the received bytes of the watched flows (all flows,
+ * or only those to the ports passed to Watch) are turned into one batch
+ * mean in Mbps. Over the last window batches the 95% confidence half-width
+ * of the mean is computed (batch means method); when it is within
+ * tolerance of the mean, Simulator::Stop is called. Batches before the
+ * first byte arrives are not counted, so start-up transients are skipped.
+ *
+ * Results that are averaged over the run (FlowMonitor throughputs) stay
+ * valid; results that need every flow to finish, such as file transfer
+ * times, do not, and assignment01-ns3 leaves them out of its summary.
+ *
+ * Copy this header next to the script in scratch/ to use it.
+ */
+
+#ifndef STEADY_STATE_H
+#define STEADY_STATE_H
+
+#include <cmath>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <set>
+#include "ns3/simulator.h"
+#include "ns3/nstime.h"
+#include "ns3/flow-monitor.h"
+#include "ns3/ipv4-flow-classifier.h"
+
+namespace ns3 {
+
+class SteadyStateDetector
+{
+public:
+  SteadyStateDetector (Ptr<FlowMonitor> monitor, Ptr<Ipv4FlowClassifier> classifier,
+                       Time batch, double tolerance, uint32_t window = 10)
+    : m_monitor (monitor),
+      m_classifier (classifier),
+      m_batch (batch),
+      m_tolerance (tolerance),
+      m_window (window < 2 ? 2 : window),
+      m_lastBytes (0),
+      m_converged (false),
+      m_mean (0),
+      m_halfWidth (0)
+  {
+  }
+
+  /// Only judge flows with this destination port (may be called several times)
+  void Watch (uint16_t port)
+  {
+    m_ports.insert (port);
+  }
+
+  /// Take the first batch at start and then every batch interval until converged
+  void Start (Time start)
+  {
+    Simulator::Schedule (start + m_batch, &SteadyStateDetector::Batch, this);
+  }
+
+  bool IsConverged () const
+  {
+    return m_converged;
+  }
+
+  /// Simulated time at which the run was stopped (or the current time if it never converged)
+  Time GetStopTime () const
+  {
+    return m_converged ? m_stopTime : Simulator::Now ();
+  }
+
+  /// One line summary of when, and at what value, the run settled
+  void Report (std::ostream &os) const
+  {
+    if (m_converged)
+      {
+        os << "Steady state after " << m_stopTime.GetSeconds () << " s simulated: "
+           << m_mean << " +- " << m_halfWidth << " Mbps over the last " << m_window << " batches\n";
+      }
+    else
+      {
+        os << "Steady state not reached in " << Simulator::Now ().GetSeconds ()
+           << " s simulated (tolerance " << m_tolerance << ")\n";
+      }
+  }
+
+private:
+  void Batch ()
+  {
+    uint64_t bytes = 0;
+    const FlowMonitor::FlowStatsContainer &stats = m_monitor->GetFlowStats ();
+    for (FlowMonitor::FlowStatsContainer::const_iterator i = stats.begin (); i != stats.end (); ++i)
+      {
+        if (Watched (i->first))
+          {
+            bytes += i->second.rxBytes;
+          }
+      }
+    double mbps = (bytes - m_lastBytes) * 8.0 / m_batch.GetSeconds () / 1e6;
+    m_lastBytes = bytes;
+    if (bytes > 0)
+      {
+        m_means.push_back (mbps);
+        if (m_means.size () > m_window)
+          {
+            m_means.pop_front ();
+          }
+      }
+    if (m_means.size () == m_window && Settled ())
+      {
+        m_converged = true;
+        m_stopTime = Simulator::Now ();
+        Simulator::Stop ();
+        return;
+      }
+    Simulator::Schedule (m_batch, &SteadyStateDetector::Batch, this);
+  }
+
+  /// Whether flow id goes to a watched port; FindFlow is a linear search, so the answer is cached
+  bool Watched (FlowId id)
+  {
+    if (m_ports.empty ())
+      {
+        return true;
+      }
+    std::map<FlowId, bool>::const_iterator it = m_watched.find (id);
+    if (it != m_watched.end ())
+      {
+        return it->second;
+      }
+    bool watched = m_ports.count (m_classifier->FindFlow (id).destinationPort) > 0;
+    m_watched[id] = watched;
+    return watched;
+  }
+
+  /// Batch means test over the current window
+  bool Settled ()
+  {
+    // Two-sided 95% Student t quantiles for 1..20 degrees of freedom
+    static const double t95[] = { 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                  2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086 };
+    double n = m_means.size ();
+    double sum = 0, sq = 0;
+    for (std::deque<double>::const_iterator i = m_means.begin (); i != m_means.end (); ++i)
+      {
+        sum += *i;
+      }
+    m_mean = sum / n;
+    for (std::deque<double>::const_iterator i = m_means.begin (); i != m_means.end (); ++i)
+      {
+        sq += (*i - m_mean) * (*i - m_mean);
+      }
+    double t = m_means.size () - 1 <= 20 ? t95[m_means.size () - 2] : 1.96;
+    m_halfWidth = t * std::sqrt (sq / (n - 1) / n);
+    return m_mean > 0 && m_halfWidth <= m_tolerance * m_mean;
+  }
+
+  Ptr<FlowMonitor> m_monitor;
+  Ptr<Ipv4FlowClassifier> m_classifier;
+  Time m_batch;
+  double m_tolerance;
+  uint32_t m_window;
+  std::set<uint16_t> m_ports;
+  std::map<FlowId, bool> m_watched;      //!< Watched () answers per flow
+  uint64_t m_lastBytes;
+  std::deque<double> m_means;            //!< last window batch means in Mbps
+  bool m_converged;
+  Time m_stopTime;
+  double m_mean;
+  double m_halfWidth;
+};
+
+} // namespace ns3
+
+#endif /* STEADY_STATE_H */
@@ -0,0 +1,338 @@
+"""Parallel parameter sweep for the ns-3 scripts
+
+Every sweep point is an independent simulation, so each one is run as a
+separate process and all cores are kept busy. The per-point summary lines
+printed by the script are collected into a single CSV table. A run must
+print each summary line at most once; a script that runs several
+configurations per process needs the choice made a parameter (e.g.
+-p rtsCts=off,on for wifi-multiple-stns, whose default runs both), and
+points whose output repeats a summary are left empty in the table.
+
+With --adaptive NAME=LO:HI one parameter is not swept on a grid. A few
+evenly spaced points are run first; then every point where the curve is
+not linear (the line through its neighbours misses it by more than
+--refine-tol of the curve's range) gets its steeper interval bisected,
+round after round. Both intervals around the largest change of
+slope are always bisected too, so the sharpest bend ends up between
+points less than --resolution apart. Points end up around saturation knees and
+window cliffs instead of on the flat parts.
+
+With --reps K every point is replicated with different --RngRun values and
+the table holds the mean and 95% confidence half-width of every metric.
+Replications are added in rounds and stop early once the half-width of
+--metric is within --rel-ci of its mean.
+
+Examples (run from the ns-3 source tree after `./waf build`):
+    python3 sweep.py --ns3-dir ~/ns-3.30 --M 4 --window 1000:5000:500 \
+        --data-rate 4:52:4 --payload 2200 -o results.csv
+    python3 sweep.py --ns3-dir ~/ns-3.30 --adaptive senderWindowSize=500:5000 \
+        --metric ftp_tput --resolution 10
+    python3 sweep.py --ns3-dir ~/ns-3.30 --program wifi-multiple-stns \
+        -p num=1:10:1 -p rtsCts=off,on --reps 30 --rel-ci 0.01
+"""
+
+import argparse
+import csv
+import itertools
+import math
+import os
+import re
+import subprocess
+import sys
+from collections import OrderedDict
+from concurrent.futures import ThreadPoolExecutor, as_completed
+
+SUMMARY = OrderedDict([
+    ("total_tput", re.compile(r"Total channel throughput = ([-\d.eE+naif]+)")),
+    ("cbr_tput", re.compile(r"CBR throughput = ([-\d.eE+naif]+)")),
+    ("ftp_tput", re.compile(r"FTP throughput = ([-\d.eE+naif]+)")),
+    ("ftp_delay", re.compile(r"Average File Transfer Delay = ([-\d.eE+naif]+)")),
+    ("steady_time", re.compile(r"Steady state after ([-\d.eE+]+) s simulated")),
+])
+
+# Two-sided 95% Student t quantiles for 1..30 degrees of freedom
+T95 = [12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+       2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+       2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042]
+
+
+def parse_range(text, cast=int):
+    """'a:b:s' is an inclusive range, 'a,b,c' a list, 'a' a single value."""
+    if ":" in text:
+        start, stop, step = (cast(x) for x in text.split(":"))
+        values = []
+        v = start
+        while v <= stop:
+            values.append(v)
+            v += step
+        return values
+    return [cast(x) for x in text.split(",")]
+
+
+def parse_param(text):
+    """'name=range[unit]': num=1:10:1, dataRate=2:10:2Mbps or rtsCts=off,on."""
+    name, values = text.split("=", 1)
+    m = re.match(r"^([-\d.:,]+)([A-Za-z/]*)$", values)
+    if not m:
+        return name, values.split(",")
+    return name, ["%g%s" % (v, m.group(2)) for v in parse_range(m.group(1), float)]
+
+
+def binary_path(ns3_dir, program):
+    return os.path.abspath(os.path.join(ns3_dir, "build", "scratch", program))
+
+
+def point_dir(workdir, params):
+    """Each point gets its own working directory so pcap/trace files don't collide."""
+    name = "_".join("%s-%s" % (k, v) for k, v in params.items())
+    path = os.path.join(workdir, name)
+    os.makedirs(path, exist_ok=True)
+    return path
+
+
+def run_point(ns3_dir, program, params, timeout=None, workdir="sweep-runs"):
+    """Run one simulation and return its parsed summary (or an error)."""
+    env = dict(os.environ)
+    libdir = os.path.abspath(os.path.join(ns3_dir, "build", "lib"))
+    env["LD_LIBRARY_PATH"] = libdir + os.pathsep + env.get("LD_LIBRARY_PATH", "")
+    args = [binary_path(ns3_dir, program)]
+    args += ["--%s=%s" % (k, v) for k, v in params.items()]
+    row = dict(params)
+    try:
+        proc = subprocess.run(args, env=env, cwd=point_dir(workdir, params),
+                              stdin=subprocess.DEVNULL, stdout=subprocess.PIPE,
+                              stderr=subprocess.PIPE, universal_newlines=True, timeout=timeout)
+    except subprocess.TimeoutExpired:
+        row.update({key: "" for key in SUMMARY}, status="timeout")
+        return row
+    row["status"] = "ok" if proc.returncode == 0 else "exit %d" % proc.returncode
+    for key, pattern in SUMMARY.items():
+        found = pattern.findall(proc.stdout)
+        row[key] = float(found[0]) if len(found) == 1 else ""
+        if len(found) > 1:
+            # Several runs in one process (wifi-multiple-stns defaults to
+            # --rtsCts=both): no way to tell which line belongs to the point
+            row["status"] = "%d summaries" % len(found)
+    return row
+
+
+def run_all(ns3_dir, program, points, jobs, timeout=None, workdir="sweep-runs"):
+    """Run every parameter dict in points, jobs at a time, yielding rows as they finish."""
+    with ThreadPoolExecutor(max_workers=jobs) as pool:
+        futures = [pool.submit(run_point, ns3_dir, program, p, timeout, workdir) for p in points]
+        for f in as_completed(futures):
+            yield f.result()
+
+
+def mean_ci(values):
+    """Mean and 95% confidence half-width (Student t) of a list of samples."""
+    n = len(values)
+    mean = sum(values) / n
+    if n < 2:
+        return mean, float("inf")
+    var = sum((v - mean) ** 2 for v in values) / (n - 1)
+    t = T95[n - 2] if n - 2 < len(T95) else 1.96
+    return mean, t * math.sqrt(var / n)
+
+
+def converged(rows, metric, rel_ci):
+    values = [r[metric] for r in rows if r[metric] != ""]
+    if len(values) < 2:
+        return False
+    mean, half = mean_ci(values)
+    return half <= rel_ci * abs(mean)
+
+
+def run_replicated(ns3_dir, program, points, jobs, min_reps, max_reps, metric, rel_ci,
+                   timeout=None, workdir="sweep-runs"):
+    """Replicate every point with RngRun = 1, 2, ... in concurrent rounds until
+    the confidence interval of metric is tight enough or max_reps is reached."""
+    results = [[] for _ in points]
+    while True:
+        batch = []
+        for i, p in enumerate(points):
+            n = len(results[i])
+            if n < min_reps:
+                extra = min_reps - n
+            elif n < max_reps and not converged(results[i], metric, rel_ci):
+                # Spread the idle workers over the points that still need runs
+                extra = min(max(1, jobs // len(points)), max_reps - n)
+            else:
+                continue
+            for run in range(n + 1, n + extra + 1):
+                q = OrderedDict(p)
+                q["RngRun"] = run
+                batch.append((i, q))
+        if not batch:
+            return results
+        print("Running %d replications on %d workers" % (len(batch), jobs), file=sys.stderr)
+        with ThreadPoolExecutor(max_workers=jobs) as pool:
+            futures = {pool.submit(run_point, ns3_dir, program, q, timeout, workdir): i
+                       for i, q in batch}
+            for f in as_completed(futures):
+                results[futures[f]].append(f.result())
+
+
+def summarize(point, rows):
+    """Collapse the replications of one point into mean, CI half-width and count."""
+    out = OrderedDict(point)
+    out["reps"] = len(rows)
+    for key in SUMMARY:
+        values = [r[key] for r in rows if r[key] != ""]
+        out[key] = out[key + "_ci95"] = ""
+        if values:
+            mean, half = mean_ci(values)
+            out[key] = mean
+            if not math.isinf(half):
+                out[key + "_ci95"] = half
+    out["status"] = ",".join(sorted(set(r["status"] for r in rows)))
+    return out
+
+
+def parse_interval(text):
+    """'name=lo:hi[unit]' for --adaptive; integer endpoints give integer points."""
+    name, values = text.split("=", 1)
+    m = re.match(r"^([-\d.]+):([-\d.]+)([A-Za-z/]*)$", values)
+    if not m:
+        raise ValueError("--adaptive expects NAME=LO:HI[unit], got %r" % text)
+    lo, hi, unit = m.groups()
+    return name, float(lo), float(hi), unit, "." not in lo + hi
+
+
+def evaluate(args, points):
+    """Rows for points in the same order: one run each, or replicated summaries with --reps."""
+    if args.reps > 1:
+        results = run_replicated(args.ns3_dir, args.program, points, args.jobs,
+                                 min(args.min_reps, args.reps), args.reps, args.metric,
+                                 args.rel_ci, args.timeout, args.workdir)
+        return [summarize(p, r) for p, r in zip(points, results)]
+    print("Running %d simulations on %d workers" % (len(points), args.jobs), file=sys.stderr)
+    order = {tuple(p.values()): i for i, p in enumerate(points)}
+    rows = [None] * len(points)
+    done = 0
+    for row in run_all(args.ns3_dir, args.program, points, args.jobs, args.timeout, args.workdir):
+        rows[order[tuple(row[k] for k in points[0])]] = row
+        done += 1
+        print("[%d/%d] %s" % (done, len(points), row), file=sys.stderr)
+    return rows
+
+
+def refine(args, base, name, lo, hi, unit, integer):
+    """Adaptive sweep of one parameter on top of the fixed parameters in base."""
+    resolution = args.resolution or max((hi - lo) / 100.0, 1 if integer else 0)
+
+    def value(x):
+        return "%d%s" % (x, unit) if integer else "%g%s" % (x, unit)
+
+    step = (hi - lo) / max(args.initial - 1, 1)
+    pending = sorted(set(round(lo + i * step) if integer else lo + i * step
+                         for i in range(args.initial)))
+    rows = {}
+    while pending:
+        points = []
+        for x in pending:
+            p = OrderedDict(base)
+            p[name] = value(x)
+            points.append(p)
+        rows.update(zip(pending, evaluate(args, points)))
+
+        xs = [x for x in sorted(rows) if rows[x][args.metric] != ""]
+        ys = [rows[x][args.metric] for x in xs]
+        span = max(ys) - min(ys) if ys else 0
+        # Where the straight line through a point's neighbours misses it, bisect the
+        # steeper of its two intervals (both if they are equally steep)
+        flagged = set()
+        bend, sharpest = 0.0, None
+        for i in range(1, len(xs) - 1):
+            line = ys[i - 1] + (ys[i + 1] - ys[i - 1]) * (xs[i] - xs[i - 1]) / (xs[i + 1] - xs[i - 1])
+            left, right = abs(ys[i] - ys[i - 1]), abs(ys[i + 1] - ys[i])
+            steeper = [j for j, d in ((i - 1, left), (i, right)) if d >= max(left, right)]
+            if abs(ys[i] - line) > args.refine_tol * span:
+                flagged.update(steeper)
+            change = abs((ys[i + 1] - ys[i]) / (xs[i + 1] - xs[i]) - (ys[i] - ys[i - 1]) / (xs[i] - xs[i - 1]))
+            if change > bend:
+                bend, sharpest = change, [i - 1, i]
+        # The tolerance alone stops once the bend looks small against the range;
+        # keep narrowing in on the sharpest one down to the resolution
+        if sharpest:
+            flagged.update(sharpest)
+        pending = []
+        for i in sorted(flagged):
+            a, b = xs[i], xs[i + 1]
+            mid = round((a + b) / 2.0) if integer else (a + b) / 2.0
+            if b - a > resolution and a < mid < b and mid not in rows:
+                pending.append(mid)
+    return [rows[x] for x in sorted(rows)]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--ns3-dir", default=".", help="ns-3 source tree containing build/")
+    parser.add_argument("--program", default="assignment01-ns3", help="scratch program name")
+    parser.add_argument("--M", default="4", help="number of nodes, e.g. 4:64:4")
+    parser.add_argument("--window", default="1100", help="sender window size in bytes")
+    parser.add_argument("--data-rate", default="2", help="CBR data rate in Mbps")
+    parser.add_argument("--payload", default="2200", help="CBR payload size in bytes")
+    parser.add_argument("-p", "--param", action="append", default=[],
+                        help="program parameter NAME=RANGE[unit], repeatable; "
+                             "replaces --M/--window/--data-rate/--payload")
+    parser.add_argument("--adaptive", metavar="NAME=LO:HI",
+                        help="refine this parameter where --metric bends instead of using a grid")
+    parser.add_argument("--initial", type=int, default=5, help="evenly spaced points to start from")
+    parser.add_argument("--resolution", type=float, default=None,
+                        help="bisect the sharpest bend until it is bracketed this closely "
+                             "(default 1%% of the range)")
+    parser.add_argument("--refine-tol", type=float, default=0.05,
+                        help="bisect where linear interpolation is off by this fraction of the range")
+    parser.add_argument("--reps", type=int, default=1, help="maximum replications per point")
+    parser.add_argument("--min-reps", type=int, default=3,
+                        help="replications before the confidence interval is checked")
+    parser.add_argument("--metric", default="total_tput", choices=list(SUMMARY),
+                        help="metric that decides when replications (or refinement) stop")
+    parser.add_argument("--rel-ci", type=float, default=0.02,
+                        help="stop once the 95%% CI half-width is within this fraction of the mean")
+    parser.add_argument("-j", "--jobs", type=int, default=os.cpu_count(), help="parallel simulations")
+    parser.add_argument("--timeout", type=float, default=None, help="per-simulation timeout (s)")
+    parser.add_argument("--workdir", default="sweep-runs", help="per-point working directories")
+    parser.add_argument("-o", "--output", default="sweep.csv", help="results table (CSV)")
+    args = parser.parse_args()
+
+    if args.param:
+        grid = OrderedDict(parse_param(p) for p in args.param)
+    else:
+        grid = OrderedDict([("M", parse_range(args.M)),
+                            ("senderWindowSize", parse_range(args.window)),
+                            ("dataRate", ["%gMbps" % r for r in parse_range(args.data_rate, float)]),
+                            ("payloadSize", parse_range(args.payload))])
+    adaptive = parse_interval(args.adaptive) if args.adaptive else None
+    if adaptive:
+        grid.pop(adaptive[0], None)
+    points = [OrderedDict(zip(grid, values)) for values in itertools.product(*grid.values())]
+
+    if adaptive:
+        rows = []
+        for base in points:
+            rows += refine(args, base, *adaptive)
+        print("Adaptive sweep used %d simulation points" % len(rows), file=sys.stderr)
+        grid[adaptive[0]] = None
+    else:
+        rows = evaluate(args, points)
+
+    fields = list(grid)
+    if args.reps > 1:
+        fields.append("reps")
+        for key in SUMMARY:
+            fields += [key, key + "_ci95"]
+    else:
+        fields += list(SUMMARY)
+    fields.append("status")
+
+    with open(args.output, "w", newline="") as f:
+        writer = csv.DictWriter(f, fieldnames=fields)
+        writer.writeheader()
+        writer.writerows(rows)
+
+
+if __name__ == "__main__":
+    main()
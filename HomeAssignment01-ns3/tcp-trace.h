@@ -0,0 +1,232 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Binary time series of the congestion state of TCP senders.
+ *
+ * For every watched socket the CongestionWindow, SlowStartThreshold and RTT
+ * traces of TcpSocketBase and a bandwidth estimate are recorded. The
+ * estimate is TcpWestwood's EstimatedBW trace when the socket exposes its
+ * congestion control (a CongestionOps attribute, newer ns-3 only);
+ * otherwise the tracer derives it the way Westwood+ does, from the bytes
+ * cumulatively acknowledged (HighestRxAck) over each RTT, smoothed with
+ * the same Tustin filter (alpha 0.9). With a
+ * decimation factor n only every n-th change of each series is kept (the
+ * first one always is). Records go into a buffer allocated up front that
+ * is written out when full and by Close:
+ *
+ *   char    magic[8]       "NS3TCPT1"
+ *   uint32  recordSize     24
+ *   uint32  decimation
+ *   records { int64 time (ns); double value; uint16 socket;
+ *             uint8 series (0 cwnd bytes, 1 ssthresh bytes, 2 rtt s, 3 bw bytes/s);
+ *             uint8 reserved[5] }
+ *
+ * which numpy reads with
+ *
+ *   np.fromfile (f, offset=16, dtype=[("time", "<i8"), ("value", "<f8"), ("socket", "<u2"),
+ *                ("series", "u1"), ("pad", "V5")])
+ *
+ * Copy this header next to the script in scratch/ to use it.
+ */
+
+#ifndef TCP_TRACE_H
+#define TCP_TRACE_H
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "ns3/fatal-error.h"
+#include "ns3/simulator.h"
+#include "ns3/nstime.h"
+#include "ns3/pointer.h"
+#include "ns3/sequence-number.h"
+#include "ns3/bulk-send-application.h"
+#include "ns3/tcp-socket-base.h"
+#include "ns3/tcp-congestion-ops.h"
+
+namespace ns3 {
+
+class TcpTracer
+{
+public:
+  enum Series
+  {
+    CWND = 0,
+    SSTHRESH = 1,
+    RTT = 2,
+    BW = 3
+  };
+
+  TcpTracer (std::string fileName, uint32_t decimation = 1, uint32_t capacity = 65536)
+    : m_decimation (decimation < 1 ? 1 : decimation),
+      m_records (capacity < 1 ? 1 : capacity),
+      m_used (0),
+      m_out (fileName.c_str (), std::ios::binary)
+  {
+    if (!m_out)
+      {
+        NS_FATAL_ERROR ("cannot open " << fileName);
+      }
+    uint32_t header[2] = { sizeof (Record), m_decimation };
+    m_out.write ("NS3TCPT1", 8);
+    m_out.write (reinterpret_cast<const char *> (header), sizeof (header));
+  }
+
+  ~TcpTracer ()
+  {
+    Close ();
+  }
+
+  /// Trace socket; returns its socket number in the trace
+  uint16_t Add (Ptr<TcpSocketBase> socket)
+  {
+    uint16_t index = m_seen.size () / 4;
+    m_seen.resize (m_seen.size () + 4, 0);
+    socket->TraceConnectWithoutContext ("CongestionWindow",
+                                        MakeBoundCallback (&TcpTracer::Bytes, this, index, static_cast<uint8_t> (CWND)));
+    socket->TraceConnectWithoutContext ("SlowStartThreshold",
+                                        MakeBoundCallback (&TcpTracer::Bytes, this, index, static_cast<uint8_t> (SSTHRESH)));
+    socket->TraceConnectWithoutContext ("RTT", MakeBoundCallback (&TcpTracer::Rtt, this, index));
+    m_estimates.push_back (Estimate ());
+    PointerValue ops;
+    if (socket->GetAttributeFailSafe ("CongestionOps", ops) && ops.Get<TcpCongestionOps> ()
+        && ops.Get<TcpCongestionOps> ()->TraceConnectWithoutContext ("EstimatedBW",
+                                                                     MakeBoundCallback (&TcpTracer::Bandwidth, this, index)))
+      {
+        return index;
+      }
+    socket->TraceConnectWithoutContext ("HighestRxAck", MakeBoundCallback (&TcpTracer::Acked, this, index));
+    return index;
+  }
+
+  /**
+   * Trace the socket of a BulkSendApplication. The socket only exists once
+   * the application has started, so it is looked up just after start.
+   */
+  void Add (Ptr<BulkSendApplication> app, Time start)
+  {
+    Simulator::Schedule (start + NanoSeconds (1), &TcpTracer::AddApplication, this, app);
+  }
+
+  /// Write out the records still in the buffer
+  void Close ()
+  {
+    if (m_out.is_open ())
+      {
+        Flush ();
+        m_out.close ();
+      }
+  }
+
+private:
+  /// Westwood+ bandwidth estimation state of a socket, for sockets without EstimatedBW
+  struct Estimate
+  {
+    bool started = false;
+    SequenceNumber32 lastAck;
+    uint64_t acked = 0;                  //!< bytes acknowledged since the last sample
+    Time sampleStart;
+    Time rtt;
+    double lastSample = 0;
+    double bw = 0;
+  };
+
+  struct Record
+  {
+    int64_t time;
+    double value;
+    uint16_t socket;
+    uint8_t series;
+    uint8_t reserved[5];
+  };
+
+  void AddApplication (Ptr<BulkSendApplication> app)
+  {
+    Ptr<TcpSocketBase> socket = DynamicCast<TcpSocketBase> (app->GetSocket ());
+    if (socket)
+      {
+        Add (socket);
+      }
+  }
+
+  void Push (uint16_t socket, uint8_t series, double value)
+  {
+    if (m_seen[socket * 4 + series]++ % m_decimation != 0)
+      {
+        return;
+      }
+    Record &r = m_records[m_used];
+    r.time = Simulator::Now ().GetNanoSeconds ();
+    r.value = value;
+    r.socket = socket;
+    r.series = series;
+    std::fill (r.reserved, r.reserved + sizeof (r.reserved), 0);
+    if (++m_used == m_records.size ())
+      {
+        Flush ();
+      }
+  }
+
+  void Flush ()
+  {
+    m_out.write (reinterpret_cast<const char *> (m_records.data ()), m_used * sizeof (Record));
+    m_used = 0;
+  }
+
+  static void Bytes (TcpTracer *tracer, uint16_t socket, uint8_t series, uint32_t oldValue, uint32_t newValue)
+  {
+    tracer->Push (socket, series, newValue);
+  }
+
+  static void Rtt (TcpTracer *tracer, uint16_t socket, Time oldValue, Time newValue)
+  {
+    tracer->m_estimates[socket].rtt = newValue;
+    tracer->Push (socket, RTT, newValue.GetSeconds ());
+  }
+
+  /// One bandwidth sample per RTT: acknowledged bytes over the time they took
+  static void Acked (TcpTracer *tracer, uint16_t socket, SequenceNumber32 oldValue, SequenceNumber32 newValue)
+  {
+    Estimate &e = tracer->m_estimates[socket];
+    Time now = Simulator::Now ();
+    if (!e.started)
+      {
+        e.started = true;
+        e.lastAck = newValue;
+        e.sampleStart = now;
+        return;
+      }
+    if (newValue > e.lastAck)
+      {
+        e.acked += newValue - e.lastAck;
+        e.lastAck = newValue;
+      }
+    Time elapsed = now - e.sampleStart;
+    if (e.rtt.IsZero () || elapsed < e.rtt || elapsed.IsZero ())
+      {
+        return;
+      }
+    double sample = e.acked / elapsed.GetSeconds ();
+    e.bw = 0.9 * e.bw + 0.1 * (sample + e.lastSample) / 2;
+    e.lastSample = sample;
+    e.acked = 0;
+    e.sampleStart = now;
+    tracer->Push (socket, BW, e.bw);
+  }
+
+  static void Bandwidth (TcpTracer *tracer, uint16_t socket, double oldValue, double newValue)
+  {
+    tracer->Push (socket, BW, newValue);
+  }
+
+  uint32_t m_decimation;
+  std::vector<Record> m_records;         //!< preallocated buffer, m_used of them filled
+  uint32_t m_used;
+  std::vector<uint32_t> m_seen;          //!< changes seen per socket and series, for decimation
+  std::vector<Estimate> m_estimates;     //!< per socket
+  std::ofstream m_out;
+};
+
+} // namespace ns3
+
+#endif /* TCP_TRACE_H */
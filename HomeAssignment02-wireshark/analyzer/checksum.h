@@ -0,0 +1,262 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Internet (RFC 1071) one's-complement sums with SSE2/AVX2 and a scalar
+ * fallback, and IPv4/TCP/UDP checksum verification on decoded packets.
+ *
+ * The sum is byte order independent (RFC 1071 section 2): the data is
+ * summed as little-endian 16-bit words, which vectorises without shuffles,
+ * and the folded result is byte-swapped once at the end. The vector loops
+ * add the two 16-bit halves of every 32-bit lane into 32-bit accumulators;
+ * a lane gains at most 2 x 0xffff per block, so they cannot overflow for
+ * anything that fits in an IPv4 packet. AVX2 is picked at run time when
+ * the CPU has it, so the same binary runs everywhere.
+ */
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <cstdint>
+#include <cstring>
+#include "pcap-reader.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CHECKSUM_X86 1
+#endif
+
+namespace pcap {
+
+namespace detail {
+
+/// Add the two 16-bit halves of the 32-bit lanes up to a 64-bit sum
+inline uint64_t
+FoldLanes (const uint32_t *lanes, int n)
+{
+  uint64_t sum = 0;
+  for (int i = 0; i < n; ++i)
+    {
+      sum += lanes[i];
+    }
+  return sum;
+}
+
+/// Little-endian 16-bit word sum of data, not folded
+inline uint64_t
+SumScalar (const uint8_t *data, size_t len)
+{
+  uint64_t sum = 0;
+  while (len >= 8)
+    {
+      uint64_t v;
+      std::memcpy (&v, data, 8);
+      sum += (v & 0xffffffffu) + (v >> 32);
+      data += 8;
+      len -= 8;
+    }
+  while (len >= 2)
+    {
+      uint16_t v;
+      std::memcpy (&v, data, 2);
+      sum += v;
+      data += 2;
+      len -= 2;
+    }
+  if (len)
+    {
+      sum += data[0];  // odd byte: high byte of a big-endian word, low byte here
+    }
+  return sum;
+}
+
+#ifdef CHECKSUM_X86
+inline uint64_t
+SumSse2 (const uint8_t *data, size_t len)
+{
+  const __m128i low = _mm_set1_epi32 (0xffff);
+  __m128i acc = _mm_setzero_si128 ();
+  while (len >= 16)
+    {
+      __m128i v = _mm_loadu_si128 (reinterpret_cast<const __m128i *> (data));
+      acc = _mm_add_epi32 (acc, _mm_and_si128 (v, low));
+      acc = _mm_add_epi32 (acc, _mm_srli_epi32 (v, 16));
+      data += 16;
+      len -= 16;
+    }
+  uint32_t lanes[4];
+  _mm_storeu_si128 (reinterpret_cast<__m128i *> (lanes), acc);
+  return FoldLanes (lanes, 4) + SumScalar (data, len);
+}
+
+__attribute__ ((target ("avx2"))) inline uint64_t
+SumAvx2 (const uint8_t *data, size_t len)
+{
+  const __m256i low = _mm256_set1_epi32 (0xffff);
+  __m256i acc = _mm256_setzero_si256 ();
+  while (len >= 32)
+    {
+      __m256i v = _mm256_loadu_si256 (reinterpret_cast<const __m256i *> (data));
+      acc = _mm256_add_epi32 (acc, _mm256_and_si256 (v, low));
+      acc = _mm256_add_epi32 (acc, _mm256_srli_epi32 (v, 16));
+      data += 32;
+      len -= 32;
+    }
+  uint32_t lanes[8];
+  _mm256_storeu_si256 (reinterpret_cast<__m256i *> (lanes), acc);
+  return FoldLanes (lanes, 8) + SumSse2 (data, len);
+}
+#endif
+
+} // namespace detail
+
+/// Implementation used by Sum; the default picks the widest one the CPU supports
+enum SumKernel
+{
+  SUM_AUTO,
+  SUM_SCALAR,
+  SUM_SSE2,
+  SUM_AVX2
+};
+
+inline SumKernel &
+ActiveKernel ()
+{
+  static SumKernel kernel = SUM_AUTO;
+  return kernel;
+}
+
+/// Select a kernel (for benchmarking); unsupported ones fall back to the next narrower
+inline SumKernel
+SetSumKernel (SumKernel kernel)
+{
+#ifdef CHECKSUM_X86
+  __builtin_cpu_init ();
+  bool avx2 = __builtin_cpu_supports ("avx2");
+  if (kernel == SUM_AUTO || (kernel == SUM_AVX2 && !avx2))
+    {
+      kernel = avx2 ? SUM_AVX2 : SUM_SSE2;
+    }
+#else
+  kernel = SUM_SCALAR;
+#endif
+  ActiveKernel () = kernel;
+  return kernel;
+}
+
+/// One's-complement sum of data in network byte order, folded to 16 bits (not complemented)
+inline uint16_t
+Sum (const uint8_t *data, size_t len, uint64_t initial = 0)
+{
+  if (ActiveKernel () == SUM_AUTO)
+    {
+      SetSumKernel (SUM_AUTO);
+    }
+  uint64_t sum = initial;
+  switch (ActiveKernel ())
+    {
+#ifdef CHECKSUM_X86
+    case SUM_AVX2: sum += detail::SumAvx2 (data, len); break;
+    case SUM_SSE2: sum += detail::SumSse2 (data, len); break;
+#endif
+    default: sum += detail::SumScalar (data, len); break;
+    }
+  while (sum >> 16)
+    {
+      sum = (sum & 0xffff) + (sum >> 16);
+    }
+  return __builtin_bswap16 (static_cast<uint16_t> (sum));
+}
+
+/// Fold of big-endian (host order) 16-bit values into a little-endian partial sum for Sum's initial
+inline uint64_t
+HostWord (uint16_t v)
+{
+  return __builtin_bswap16 (v);
+}
+
+enum ChecksumStatus
+{
+  CSUM_OK,
+  CSUM_BAD,
+  CSUM_OFFLOAD,     //!< not filled in yet by the NIC (transmit checksum/segmentation offload)
+  CSUM_UNCHECKED    //!< truncated capture, fragment or no checksum
+};
+
+struct ChecksumResult
+{
+  ChecksumStatus ip;
+  ChecksumStatus l4;
+};
+
+/**
+ * Verify the IPv4 header checksum and the TCP/UDP checksum of a decoded
+ * packet. A wrong transport checksum counts as an offload artifact rather
+ * than corruption when the field holds what a sender with checksum offload
+ * leaves there: 0, or the pseudo-header sum (Linux CHECKSUM_PARTIAL).
+ * Complete segments are always summed, however long; a segment cut short
+ * of its IPv4 total length is only called an offload super-packet when
+ * that length is 0 or more than a wire frame holds, and is otherwise
+ * judged by the field alone. An IPv4 header checksum of 0
+ * is an artifact too: hosts with header checksum offload (Windows by
+ * default) leave it that way on every packet they send.
+ */
+inline ChecksumResult
+VerifyChecksums (const Packet &pkt, const uint8_t *frameEnd)
+{
+  ChecksumResult r = { CSUM_UNCHECKED, CSUM_UNCHECKED };
+  if (!pkt.ip || pkt.ipHeaderLen < 20 || pkt.ip + pkt.ipHeaderLen > frameEnd)
+    {
+      return r;
+    }
+  uint16_t ipField = Load16 (pkt.ip + 10);
+  if (Sum (pkt.ip, pkt.ipHeaderLen) == 0xffff)
+    {
+      r.ip = CSUM_OK;
+    }
+  else
+    {
+      r.ip = ipField == 0 ? CSUM_OFFLOAD : CSUM_BAD;
+    }
+
+  if (!pkt.l4 || pkt.fragment || (pkt.proto != 6 && pkt.proto != 17))
+    {
+      return r;
+    }
+  uint32_t l4Len = pkt.ipLen > pkt.ipHeaderLen ? pkt.ipLen - pkt.ipHeaderLen : 0;
+  if (pkt.proto == 17)
+    {
+      l4Len = Load16 (pkt.l4 + 4);
+    }
+  uint16_t field = Load16 (pkt.l4 + (pkt.proto == 6 ? 16 : 6));
+  if (pkt.proto == 17 && field == 0)
+    {
+      return r;                          // UDP without a checksum
+    }
+  // Pseudo-header: addresses, protocol and transport length
+  uint64_t pseudo = HostWord (pkt.src >> 16) + HostWord (pkt.src & 0xffff) + HostWord (pkt.dst >> 16)
+                    + HostWord (pkt.dst & 0xffff) + HostWord (pkt.proto);
+  uint16_t pseudoSum = Sum (0, 0, pseudo + HostWord (l4Len));
+  bool partial = field == pseudoSum || field == static_cast<uint16_t> (~pseudoSum);
+  if (l4Len < 8 || pkt.l4 + l4Len > frameEnd)
+    {
+      // The segment is not all there: a TSO super-packet (no IP length, or
+      // longer than any wire frame) is an offload artifact, a snaplen cut
+      // can only be judged by the field
+      bool tso = pkt.ipLen == 0 || (pkt.ipLen > 1500 && pkt.ip + pkt.ipLen > frameEnd);
+      r.l4 = tso || partial ? CSUM_OFFLOAD : CSUM_UNCHECKED;
+      return r;
+    }
+  // Complete segments are always summed, whatever their size
+  if (Sum (pkt.l4, l4Len, pseudo + HostWord (l4Len)) == 0xffff)
+    {
+      r.l4 = CSUM_OK;
+    }
+  else
+    {
+      r.l4 = field == 0 || partial ? CSUM_OFFLOAD : CSUM_BAD;
+    }
+  return r;
+}
+
+} // namespace pcap
+
+#endif /* CHECKSUM_H */
@@ -0,0 +1,164 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Per-flow (five-tuple) packet/byte/time aggregates of a capture, decoded
+ * in parallel chunks by a pool of threads and merged at the end.
+ *
+ * Build: g++ -O2 -std=c++11 -pthread -o flow-stats flow-stats.cc
+ * Usage: ./flow-stats [-j threads] [-n top] [-Y filter] capture.pcap
+ *   -Y  only count matching packets (see packet-filter.h)
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+#include <getopt.h>
+#include "packet-filter.h"
+#include "parallel-ingest.h"
+
+namespace {
+
+struct FlowKey
+{
+  uint32_t src;
+  uint32_t dst;
+  uint16_t sport;
+  uint16_t dport;
+  uint8_t proto;
+
+  bool operator== (const FlowKey &o) const
+  {
+    return src == o.src && dst == o.dst && sport == o.sport && dport == o.dport && proto == o.proto;
+  }
+};
+
+struct FlowKeyHash
+{
+  size_t operator() (const FlowKey &k) const
+  {
+    uint64_t h = (static_cast<uint64_t> (k.src) << 32 | k.dst) * 0x9e3779b97f4a7c15ull;
+    h ^= (static_cast<uint64_t> (k.sport) << 24 | static_cast<uint64_t> (k.dport) << 8 | k.proto)
+         * 0xc2b2ae3d27d4eb4full;
+    return static_cast<size_t> (h ^ (h >> 29));
+  }
+};
+
+struct FlowAgg
+{
+  uint64_t packets = 0;
+  uint64_t bytes = 0;
+  uint64_t first = ~0ull;
+  uint64_t last = 0;
+
+  void Merge (const FlowAgg &o)
+  {
+    packets += o.packets;
+    bytes += o.bytes;
+    first = std::min (first, o.first);
+    last = std::max (last, o.last);
+  }
+};
+
+struct State
+{
+  std::unordered_map<FlowKey, FlowAgg, FlowKeyHash> flows;
+  uint64_t packets = 0;
+  uint64_t bytes = 0;
+};
+
+pcap::PacketFilter g_filter;
+
+void
+Process (State &state, const pcap::Record &rec)
+{
+  pcap::Packet pkt;
+  bool ip = pcap::Decode (rec.linkType, rec.data, rec.caplen, pkt);
+  if (!g_filter.Matches (rec, pkt, ip))
+    {
+      return;
+    }
+  state.packets++;
+  state.bytes += rec.len;
+  if (!ip)
+    {
+      return;
+    }
+  FlowKey key = { pkt.src, pkt.dst, pkt.sport, pkt.dport, pkt.proto };
+  FlowAgg &agg = state.flows[key];
+  agg.packets++;
+  agg.bytes += rec.len;
+  agg.first = std::min (agg.first, rec.tsNs);
+  agg.last = std::max (agg.last, rec.tsNs);
+}
+
+} // namespace
+
+int
+main (int argc, char **argv)
+{
+  unsigned threads = 0;
+  size_t top = 20;
+  std::string expression;
+  int opt;
+  while ((opt = getopt (argc, argv, "j:n:Y:")) != -1)
+    {
+      switch (opt)
+        {
+        case 'j': threads = std::atoi (optarg); break;
+        case 'n': top = std::strtoul (optarg, 0, 10); break;
+        case 'Y': expression = optarg; break;
+        default:
+          std::cerr << "usage: " << argv[0] << " [-j threads] [-n top] [-Y filter] capture.pcap\n";
+          return 1;
+        }
+    }
+  if (optind != argc - 1)
+    {
+      std::cerr << "usage: " << argv[0] << " [-j threads] [-n top] [-Y filter] capture.pcap\n";
+      return 1;
+    }
+
+  try
+    {
+      g_filter = pcap::PacketFilter (expression);
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+      pcap::PcapReader reader (argv[optind]);
+      std::vector<State> states = pcap::ParallelIngest<State> (reader, threads, Process);
+
+      // Merge into the first worker's state
+      State &total = states[0];
+      for (size_t i = 1; i < states.size (); ++i)
+        {
+          total.packets += states[i].packets;
+          total.bytes += states[i].bytes;
+          for (auto it = states[i].flows.begin (); it != states[i].flows.end (); ++it)
+            {
+              total.flows[it->first].Merge (it->second);
+            }
+        }
+      double elapsed = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+
+      std::vector<std::pair<FlowKey, FlowAgg> > flows (total.flows.begin (), total.flows.end ());
+      std::sort (flows.begin (), flows.end (),
+                 [] (const std::pair<FlowKey, FlowAgg> &a, const std::pair<FlowKey, FlowAgg> &b) {
+                   return a.second.bytes > b.second.bytes;
+                 });
+      std::cout << total.packets << " packets, " << total.bytes << " bytes, " << flows.size () << " flows, "
+                << states.size () << " threads, " << reader.File ().Size () / elapsed / 1e6 << " MB/s\n";
+      for (size_t i = 0; i < flows.size () && i < top; ++i)
+        {
+          const FlowKey &k = flows[i].first;
+          const FlowAgg &a = flows[i].second;
+          std::cout << "  " << pcap::FormatIpv4 (k.src) << ":" << k.sport << " -> " << pcap::FormatIpv4 (k.dst)
+                    << ":" << k.dport << " proto " << unsigned (k.proto) << "  " << a.packets << " packets, "
+                    << a.bytes << " bytes, " << (a.last - a.first) / 1e9 << " s\n";
+        }
+    }
+  catch (const std::exception &e)
+    {
+      std::cerr << "error: " << e.what () << "\n";
+      return 1;
+    }
+  return 0;
+}
@@ -0,0 +1,285 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Streaming parser for logs of back-to-back netstat snapshots (Windows
+ * "Active Connections" and Linux "Active Internet connections" output).
+ *
+ * The log is read line by line and only the current state of every socket
+ * (proto, local, foreign) plus its list of state changes is kept, so memory
+ * grows with the number of distinct sockets and transitions, not with the
+ * number of snapshots. A socket missing from a snapshot is recorded as
+ * "-" (gone) and reappears as a new transition.
+ *
+ * Build: g++ -O2 -std=c++11 -o netstat-timeline netstat-timeline.cc
+ * Usage: ./netstat-timeline [-i seconds_per_snapshot] [-a] netstat_log
+ *        -a also lists sockets whose state never changed
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <getopt.h>
+
+namespace {
+
+/// A state change: snapshot index and interned state name
+struct Transition
+{
+  uint32_t snapshot;
+  uint16_t state;
+};
+
+struct Socket
+{
+  std::string key;                      //!< "proto local foreign"
+  uint16_t state;
+  uint32_t lastSeen;
+  std::vector<Transition> transitions;
+};
+
+class Timeline
+{
+public:
+  Timeline ()
+    : m_snapshot (0),
+      m_inSnapshot (false),
+      m_truncated (false)
+  {
+    Intern ("-");  // state 0: not present in the snapshot
+  }
+
+  void Line (const std::string &raw)
+  {
+    std::string line = raw;
+    if (!line.empty () && line[line.size () - 1] == '\r')
+      {
+        line.erase (line.size () - 1);
+      }
+    if (line.find ("Active Connections") != std::string::npos
+        || line.find ("Active Internet connections") != std::string::npos)
+      {
+        EndSnapshot ();
+        m_inSnapshot = true;
+        return;
+      }
+    if (!m_inSnapshot)
+      {
+        return;
+      }
+    std::istringstream in (line);
+    std::vector<std::string> f;
+    std::string word;
+    while (in >> word)
+      {
+        f.push_back (word);
+      }
+    if (f.empty ())
+      {
+        return;
+      }
+    std::string proto = f[0];
+    std::transform (proto.begin (), proto.end (), proto.begin (), ::toupper);
+    if (proto.compare (0, 3, "TCP") != 0 && proto.compare (0, 3, "UDP") != 0)
+      {
+        return;  // column headers and anything else
+      }
+    // Linux: proto recv-q send-q local foreign [state]; Windows: proto local foreign [state]
+    size_t base = (f.size () >= 3 && IsNumber (f[1]) && IsNumber (f[2])) ? 3 : 1;
+    bool udp = proto.compare (0, 3, "UDP") == 0;
+    // Only UDP rows may lack the state column; anything shorter is a cut-off
+    // line, e.g. at the end of the log
+    if (f.size () < base + 2 || (f.size () == base + 2 && !udp))
+      {
+        m_truncated = true;
+        return;
+      }
+    std::string state = f.size () > base + 2 ? f[base + 2] : "STATELESS";
+    if (!IsState (state) || (!udp && state == "STATELESS"))
+      {
+        m_truncated = true;
+        return;
+      }
+    Observe (proto + " " + f[base] + " " + f[base + 1], Intern (state));
+  }
+
+  void Finish ()
+  {
+    EndSnapshot ();
+  }
+
+  void Report (double interval, bool all) const
+  {
+    size_t changed = 0;
+    std::vector<const Socket *> sorted;
+    for (auto it = m_sockets.begin (); it != m_sockets.end (); ++it)
+      {
+        sorted.push_back (&it->second);
+      }
+    std::sort (sorted.begin (), sorted.end (), [] (const Socket *a, const Socket *b) {
+      return a->transitions[0].snapshot != b->transitions[0].snapshot
+             ? a->transitions[0].snapshot < b->transitions[0].snapshot : a->key < b->key;
+    });
+    for (size_t i = 0; i < sorted.size (); ++i)
+      {
+        const Socket &s = *sorted[i];
+        bool stable = s.transitions.size () == 1 && s.transitions[0].snapshot == 0 && s.state != 0;
+        if (!stable)
+          {
+            changed++;
+          }
+        if (stable && !all)
+          {
+            continue;
+          }
+        std::cout << s.key << "\n   ";
+        for (size_t t = 0; t < s.transitions.size (); ++t)
+          {
+            std::cout << " " << m_states[s.transitions[t].state] << "@";
+            if (interval > 0)
+              {
+                std::cout << s.transitions[t].snapshot * interval << "s";
+              }
+            else
+              {
+                std::cout << s.transitions[t].snapshot;
+              }
+          }
+        std::cout << "\n";
+      }
+    std::cout << m_snapshot << " snapshots, " << m_sockets.size () << " sockets, " << changed
+              << " with state changes\n";
+  }
+
+private:
+  static bool IsNumber (const std::string &s)
+  {
+    return !s.empty () && s.find_first_not_of ("0123456789") == std::string::npos;
+  }
+
+  static bool IsState (const std::string &s)
+  {
+    static const char *states[] = { "ESTABLISHED", "LISTENING", "LISTEN", "TIME_WAIT", "CLOSE_WAIT",
+                                    "SYN_SENT", "SYN_RECEIVED", "SYN_RECV", "FIN_WAIT_1", "FIN_WAIT1",
+                                    "FIN_WAIT_2", "FIN_WAIT2", "LAST_ACK", "CLOSING", "CLOSED",
+                                    "CLOSE", "BOUND", "STATELESS" };
+    for (size_t i = 0; i < sizeof (states) / sizeof (states[0]); ++i)
+      {
+        if (s == states[i])
+          {
+            return true;
+          }
+      }
+    return false;
+  }
+
+  uint16_t Intern (const std::string &state)
+  {
+    for (size_t i = 0; i < m_states.size (); ++i)
+      {
+        if (m_states[i] == state)
+          {
+            return static_cast<uint16_t> (i);
+          }
+      }
+    m_states.push_back (state);
+    return static_cast<uint16_t> (m_states.size () - 1);
+  }
+
+  void Observe (const std::string &key, uint16_t state)
+  {
+    auto it = m_sockets.find (key);
+    if (it == m_sockets.end ())
+      {
+        Socket s;
+        s.key = key;
+        s.state = 0;
+        s.lastSeen = ~0u;
+        it = m_sockets.insert (std::make_pair (key, s)).first;
+      }
+    Socket &s = it->second;
+    if (s.lastSeen == m_snapshot && s.state == state && !s.transitions.empty ())
+      {
+        return;  // duplicate line within one snapshot
+      }
+    s.lastSeen = m_snapshot;
+    if (s.state != state || s.transitions.empty ())
+      {
+        s.state = state;
+        Transition t = { m_snapshot, state };
+        s.transitions.push_back (t);
+      }
+  }
+
+  /// Mark sockets not listed in the snapshot just finished as gone (unless it was cut off)
+  void EndSnapshot ()
+  {
+    if (!m_inSnapshot)
+      {
+        return;
+      }
+    for (auto it = m_sockets.begin (); it != m_sockets.end () && !m_truncated; ++it)
+      {
+        Socket &s = it->second;
+        if (s.lastSeen != m_snapshot && s.state != 0)
+          {
+            s.state = 0;
+            Transition t = { m_snapshot, 0 };
+            s.transitions.push_back (t);
+          }
+      }
+    m_snapshot++;
+    m_inSnapshot = false;
+    m_truncated = false;
+  }
+
+  uint32_t m_snapshot;
+  bool m_inSnapshot;
+  bool m_truncated;
+  std::vector<std::string> m_states;
+  std::unordered_map<std::string, Socket> m_sockets;
+};
+
+} // namespace
+
+int
+main (int argc, char **argv)
+{
+  double interval = 0;
+  bool all = false;
+  int opt;
+  while ((opt = getopt (argc, argv, "i:a")) != -1)
+    {
+      switch (opt)
+        {
+        case 'i': interval = std::atof (optarg); break;
+        case 'a': all = true; break;
+        default:
+          std::cerr << "usage: " << argv[0] << " [-i seconds_per_snapshot] [-a] netstat_log\n";
+          return 1;
+        }
+    }
+  if (optind != argc - 1)
+    {
+      std::cerr << "usage: " << argv[0] << " [-i seconds_per_snapshot] [-a] netstat_log\n";
+      return 1;
+    }
+  std::ifstream in (argv[optind]);
+  if (!in)
+    {
+      std::cerr << "error: cannot open " << argv[optind] << "\n";
+      return 1;
+    }
+  Timeline timeline;
+  std::string line;
+  while (std::getline (in, line))
+    {
+      timeline.Line (line);
+    }
+  timeline.Finish ();
+  timeline.Report (interval, all);
+  return 0;
+}
@@ -0,0 +1,582 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Packet filter expressions, compiled once into flat BPF-style bytecode.
+ *
+ * Both Wireshark display filter fields and tcpdump primitives are accepted
+ * and can be mixed:
+ *
+ *   tcp.port == 22 && ip.addr == 10.105.0.0/16
+ *   udp and not port 53
+ *   (src host 192.168.0.11 or dst net 103.21.0.0/16) and frame.len > 1000
+ *   tcp.flags.syn && !tcp.flags.ack
+ *
+ * Fields: frame.len, ip.src, ip.dst, ip.addr, ip.proto, ip.ttl, ip.len,
+ * tcp/udp.srcport, .dstport, .port, tcp.len (payload), udp.len (header
+ * included, as in the UDP header), tcp.flags and
+ * tcp.flags.fin/syn/rst/psh/ack/urg; bare ip, tcp, udp and icmp. Operators
+ * are == != < <= > >= (or eq ne lt le gt ge), and/&&, or/||, not/!.
+ * Addresses take an optional /prefix. On ip.addr and the .port fields ==
+ * matches either end and != neither, as in Wireshark.
+ *
+ * Every comparison becomes one instruction with a jump target for true
+ * and one for false, so and/or/not cost nothing at run time and evaluation
+ * stops as soon as the outcome is known. Matches walks the program over a
+ * decoded packet with no allocation; an empty filter accepts everything.
+ */
+
+#ifndef PACKET_FILTER_H
+#define PACKET_FILTER_H
+
+#include <cctype>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+#include "pcap-reader.h"
+
+namespace pcap {
+
+class PacketFilter
+{
+public:
+  /// Accepts every packet
+  PacketFilter ()
+  {
+  }
+
+  explicit PacketFilter (const std::string &expression)
+  {
+    Compiler compiler (expression);
+    if (compiler.AtEnd ())
+      {
+        return;
+      }
+    int root = compiler.Expression ();
+    if (!compiler.AtEnd ())
+      {
+        throw std::runtime_error ("filter: unexpected '" + compiler.Peek () + "'");
+      }
+    compiler.Emit (root, m_code);
+  }
+
+  bool Empty () const
+  {
+    return m_code.empty ();
+  }
+
+  /// Number of instructions (comparisons) in the compiled program
+  size_t Size () const
+  {
+    return m_code.size ();
+  }
+
+  /// pkt is the result of Decode on rec, ip what Decode returned
+  bool Matches (const Record &rec, const Packet &pkt, bool ip) const
+  {
+    const size_t n = m_code.size ();
+    size_t pc = 0;
+    while (pc < n)
+      {
+        const Insn &insn = m_code[pc];
+        pc = Test (insn, rec, pkt, ip) ? insn.jt : insn.jf;
+      }
+    return pc == n;
+  }
+
+  bool Matches (const Record &rec) const
+  {
+    if (m_code.empty ())
+      {
+        return true;
+      }
+    Packet pkt;
+    bool ip = Decode (rec.linkType, rec.data, rec.caplen, pkt);
+    return Matches (rec, pkt, ip);
+  }
+
+private:
+  enum Field
+  {
+    F_FRAME_LEN,
+    F_IP,                //!< 1 for IPv4 packets
+    F_PROTO,
+    F_TTL,
+    F_IP_LEN,
+    F_SRC,
+    F_DST,
+    F_ADDR,              //!< either address
+    F_SPORT,
+    F_DPORT,
+    F_PORT,              //!< either port
+    F_PAYLOAD_LEN,
+    F_UDP_LEN,           //!< the UDP length field, header included
+    F_TCP_FLAGS
+  };
+
+  enum Op
+  {
+    OP_EQ,
+    OP_NE,
+    OP_LT,
+    OP_LE,
+    OP_GT,
+    OP_GE
+  };
+
+  /// (field & mask) op value; jumps are instruction indices, Size () accepts and Size () + 1 rejects
+  struct Insn
+  {
+    uint8_t field;
+    uint8_t op;
+    uint32_t mask;
+    uint32_t value;
+    uint32_t jt;
+    uint32_t jf;
+  };
+
+  static bool Compare (uint32_t a, uint8_t op, uint32_t b)
+  {
+    switch (op)
+      {
+      case OP_EQ: return a == b;
+      case OP_NE: return a != b;
+      case OP_LT: return a < b;
+      case OP_LE: return a <= b;
+      case OP_GT: return a > b;
+      default: return a >= b;
+      }
+  }
+
+  static bool Test (const Insn &insn, const Record &rec, const Packet &pkt, bool ip)
+  {
+    uint32_t a, b;
+    switch (insn.field)
+      {
+      case F_FRAME_LEN:
+        return Compare (rec.len & insn.mask, insn.op, insn.value);
+      case F_IP:
+        return Compare (ip ? 1 : 0, insn.op, insn.value);
+      default:
+        break;
+      }
+    if (!ip)
+      {
+        return false;
+      }
+    switch (insn.field)
+      {
+      case F_PROTO: a = pkt.proto; break;
+      case F_TTL: a = pkt.ttl; break;
+      case F_IP_LEN: a = pkt.ipLen; break;
+      case F_SRC: a = pkt.src; break;
+      case F_DST: a = pkt.dst; break;
+      case F_ADDR:
+        a = pkt.src;
+        b = pkt.dst;
+        break;
+      default:
+        if (!pkt.l4)
+          {
+            return false;
+          }
+        switch (insn.field)
+          {
+          case F_SPORT: a = pkt.sport; break;
+          case F_DPORT: a = pkt.dport; break;
+          case F_PORT:
+            a = pkt.sport;
+            b = pkt.dport;
+            break;
+          case F_PAYLOAD_LEN: a = pkt.payloadLen; break;
+          case F_UDP_LEN: a = Load16 (pkt.l4 + 4); break;
+          default: a = pkt.tcpFlags; break;
+          }
+      }
+    if (insn.field != F_ADDR && insn.field != F_PORT)
+      {
+        return Compare (a & insn.mask, insn.op, insn.value);
+      }
+    if (insn.op == OP_NE)
+      {
+        return (a & insn.mask) != insn.value && (b & insn.mask) != insn.value;
+      }
+    return Compare (a & insn.mask, insn.op, insn.value) || Compare (b & insn.mask, insn.op, insn.value);
+  }
+
+  /// Recursive descent parser into a small tree, then code generation
+  class Compiler
+  {
+  public:
+    explicit Compiler (const std::string &text)
+    {
+      Tokenize (text);
+    }
+
+    bool AtEnd () const
+    {
+      return m_pos == m_tokens.size ();
+    }
+
+    std::string Peek () const
+    {
+      return AtEnd () ? std::string ("end of filter") : m_tokens[m_pos];
+    }
+
+    int Expression ()
+    {
+      int left = Conjunction ();
+      while (Accept ("or") || Accept ("||"))
+        {
+          left = Join (OR, left, Conjunction ());
+        }
+      return left;
+    }
+
+    /// Append the code of node; a comparison jumps to the next one or straight to the verdict
+    void Emit (int node, std::vector<Insn> &code)
+    {
+      uint32_t size = Length (node);
+      code.reserve (size);
+      Emit (node, code, size, size + 1);
+    }
+
+  private:
+    enum Kind
+    {
+      LEAF,
+      AND,
+      OR,
+      NOT
+    };
+
+    struct Node
+    {
+      Kind kind;
+      int left;
+      int right;
+      Insn insn;
+    };
+
+    void Tokenize (const std::string &text)
+    {
+      size_t i = 0;
+      while (i < text.size ())
+        {
+          char c = text[i];
+          if (std::isspace (static_cast<unsigned char> (c)))
+            {
+              i++;
+              continue;
+            }
+          size_t start = i;
+          if (std::isalnum (static_cast<unsigned char> (c)) || c == '_')
+            {
+              while (i < text.size () && (std::isalnum (static_cast<unsigned char> (text[i])) || text[i] == '_'
+                                          || text[i] == '.' || text[i] == '/'))
+                {
+                  i++;
+                }
+            }
+          else if ((c == '&' || c == '|' || c == '=') && i + 1 < text.size () && text[i + 1] == c)
+            {
+              i += 2;
+            }
+          else if ((c == '!' || c == '<' || c == '>') && i + 1 < text.size () && text[i + 1] == '=')
+            {
+              i += 2;
+            }
+          else if (c == '(' || c == ')' || c == '!' || c == '<' || c == '>')
+            {
+              i++;
+            }
+          else
+            {
+              throw std::runtime_error (std::string ("filter: unexpected character '") + c + "'");
+            }
+          m_tokens.push_back (text.substr (start, i - start));
+        }
+    }
+
+    bool Accept (const char *token)
+    {
+      if (!AtEnd () && m_tokens[m_pos] == token)
+        {
+          m_pos++;
+          return true;
+        }
+      return false;
+    }
+
+    std::string Next ()
+    {
+      if (AtEnd ())
+        {
+          throw std::runtime_error ("filter: unexpected end of filter");
+        }
+      return m_tokens[m_pos++];
+    }
+
+    int Join (Kind kind, int left, int right)
+    {
+      Node node = { kind, left, right, Insn () };
+      m_nodes.push_back (node);
+      return static_cast<int> (m_nodes.size () - 1);
+    }
+
+    int Leaf (Field field, Op op, uint32_t value, uint32_t mask = ~0u)
+    {
+      Insn insn = { static_cast<uint8_t> (field), static_cast<uint8_t> (op), mask, value & mask, 0, 0 };
+      Node node = { LEAF, -1, -1, insn };
+      m_nodes.push_back (node);
+      return static_cast<int> (m_nodes.size () - 1);
+    }
+
+    int Conjunction ()
+    {
+      int left = Negation ();
+      while (Accept ("and") || Accept ("&&"))
+        {
+          left = Join (AND, left, Negation ());
+        }
+      return left;
+    }
+
+    int Negation ()
+    {
+      if (Accept ("not") || Accept ("!"))
+        {
+          return Join (NOT, Negation (), -1);
+        }
+      return Primary ();
+    }
+
+    int Primary ()
+    {
+      if (Accept ("("))
+        {
+          int node = Expression ();
+          if (!Accept (")"))
+            {
+              throw std::runtime_error ("filter: expected ')' before " + Peek ());
+            }
+          return node;
+        }
+      std::string word = Next ();
+      if (word == "src" || word == "dst")
+        {
+          return Primitive (word, Next ());
+        }
+      if (word == "host" || word == "net" || word == "port" || word == "less" || word == "greater")
+        {
+          return Primitive ("", word);
+        }
+      return Comparison (word);
+    }
+
+    /// tcpdump style: [src|dst] host|net|port value, less|greater length
+    int Primitive (const std::string &dir, const std::string &what)
+    {
+      std::string value = Next ();
+      if (what == "less" || what == "greater")
+        {
+          return Leaf (F_FRAME_LEN, what == "less" ? OP_LE : OP_GE, Number (value));
+        }
+      if (what == "port")
+        {
+          return Leaf (dir == "src" ? F_SPORT : dir == "dst" ? F_DPORT : F_PORT, OP_EQ, Number (value));
+        }
+      if (what == "host" || what == "net")
+        {
+          uint32_t mask;
+          uint32_t addr = Address (value, mask);
+          return Leaf (dir == "src" ? F_SRC : dir == "dst" ? F_DST : F_ADDR, OP_EQ, addr, mask);
+        }
+      throw std::runtime_error ("filter: expected host, net or port after " + dir);
+    }
+
+    /// Wireshark style: field [op value]
+    int Comparison (const std::string &name)
+    {
+      static const struct
+      {
+        const char *name;
+        uint8_t proto;                   //!< implied protocol, 0 for none
+        Field field;
+        uint32_t mask;
+      } fields[] = {
+        { "frame.len", 0, F_FRAME_LEN, ~0u },
+        { "ip.proto", 0, F_PROTO, ~0u },
+        { "ip.ttl", 0, F_TTL, ~0u },
+        { "ip.len", 0, F_IP_LEN, ~0u },
+        { "ip.src", 0, F_SRC, ~0u },
+        { "ip.dst", 0, F_DST, ~0u },
+        { "ip.addr", 0, F_ADDR, ~0u },
+        { "tcp.srcport", 6, F_SPORT, ~0u },
+        { "tcp.dstport", 6, F_DPORT, ~0u },
+        { "tcp.port", 6, F_PORT, ~0u },
+        { "tcp.len", 6, F_PAYLOAD_LEN, ~0u },
+        { "tcp.flags", 6, F_TCP_FLAGS, ~0u },
+        { "tcp.flags.fin", 6, F_TCP_FLAGS, TCP_FIN },
+        { "tcp.flags.syn", 6, F_TCP_FLAGS, TCP_SYN },
+        { "tcp.flags.rst", 6, F_TCP_FLAGS, TCP_RST },
+        { "tcp.flags.psh", 6, F_TCP_FLAGS, TCP_PSH },
+        { "tcp.flags.ack", 6, F_TCP_FLAGS, TCP_ACK },
+        { "tcp.flags.urg", 6, F_TCP_FLAGS, TCP_URG },
+        { "udp.srcport", 17, F_SPORT, ~0u },
+        { "udp.dstport", 17, F_DPORT, ~0u },
+        { "udp.port", 17, F_PORT, ~0u },
+        { "udp.len", 17, F_UDP_LEN, ~0u },
+      };
+
+      if (name == "ip")
+        {
+          return Leaf (F_IP, OP_EQ, 1);
+        }
+      if (name == "tcp" || name == "udp" || name == "icmp")
+        {
+          return Leaf (F_PROTO, OP_EQ, name == "tcp" ? 6 : name == "udp" ? 17 : 1);
+        }
+      for (size_t i = 0; i < sizeof (fields) / sizeof (fields[0]); ++i)
+        {
+          if (name != fields[i].name)
+            {
+              continue;
+            }
+          int node;
+          Op op;
+          if (fields[i].mask != ~0u && !Operator (op))
+            {
+              node = Leaf (fields[i].field, OP_NE, 0, fields[i].mask);   // bare flag: set
+            }
+          else
+            {
+              if (fields[i].mask == ~0u && !Operator (op))
+                {
+                  throw std::runtime_error ("filter: expected a comparison after " + name);
+                }
+              std::string value = Next ();
+              uint32_t mask = fields[i].mask;
+              uint32_t v;
+              if (fields[i].field == F_SRC || fields[i].field == F_DST || fields[i].field == F_ADDR)
+                {
+                  v = Address (value, mask);
+                }
+              else
+                {
+                  v = Number (value);
+                  if (mask != ~0u)
+                    {
+                      v = v ? mask : 0;          // tcp.flags.syn == 1
+                    }
+                }
+              node = Leaf (fields[i].field, op, v, mask);
+            }
+          return fields[i].proto ? Join (AND, Leaf (F_PROTO, OP_EQ, fields[i].proto), node) : node;
+        }
+      throw std::runtime_error ("filter: unknown field " + name);
+    }
+
+    bool Operator (Op &op)
+    {
+      static const struct
+      {
+        const char *symbol;
+        const char *word;
+        Op op;
+      } ops[] = {
+        { "==", "eq", OP_EQ }, { "!=", "ne", OP_NE }, { "<", "lt", OP_LT },
+        { "<=", "le", OP_LE }, { ">", "gt", OP_GT }, { ">=", "ge", OP_GE },
+      };
+      for (size_t i = 0; i < sizeof (ops) / sizeof (ops[0]); ++i)
+        {
+          if (Accept (ops[i].symbol) || Accept (ops[i].word))
+            {
+              op = ops[i].op;
+              return true;
+            }
+        }
+      return false;
+    }
+
+    static uint32_t Number (const std::string &text)
+    {
+      char *end;
+      unsigned long v = std::strtoul (text.c_str (), &end, 0);
+      if (text.empty () || *end)
+        {
+          throw std::runtime_error ("filter: bad number " + text);
+        }
+      return static_cast<uint32_t> (v);
+    }
+
+    /// addr[/prefix] in host byte order, with the prefix as mask
+    static uint32_t Address (const std::string &text, uint32_t &mask)
+    {
+      size_t slash = text.find ('/');
+      struct in_addr in;
+      if (inet_pton (AF_INET, text.substr (0, slash).c_str (), &in) != 1)
+        {
+          throw std::runtime_error ("filter: bad address " + text);
+        }
+      mask = ~0u;
+      if (slash != std::string::npos)
+        {
+          uint32_t bits = Number (text.substr (slash + 1));
+          if (bits > 32)
+            {
+              throw std::runtime_error ("filter: bad prefix " + text);
+            }
+          mask = bits ? ~0u << (32 - bits) : 0;
+        }
+      return ntohl (in.s_addr) & mask;
+    }
+
+    /// Comparisons in node, which is also the number of instructions it compiles to
+    uint32_t Length (int node) const
+    {
+      const Node &n = m_nodes[node];
+      switch (n.kind)
+        {
+        case LEAF: return 1;
+        case NOT: return Length (n.left);
+        default: return Length (n.left) + Length (n.right);
+        }
+    }
+
+    void Emit (int node, std::vector<Insn> &code, uint32_t jt, uint32_t jf)
+    {
+      const Node &n = m_nodes[node];
+      uint32_t next = static_cast<uint32_t> (code.size ()) + (n.kind == LEAF ? 1 : Length (n.left));
+      switch (n.kind)
+        {
+        case LEAF:
+          code.push_back (n.insn);
+          code.back ().jt = jt;
+          code.back ().jf = jf;
+          break;
+        case NOT:
+          Emit (n.left, code, jf, jt);
+          break;
+        case AND:
+          Emit (n.left, code, next, jf);
+          Emit (n.right, code, jt, jf);
+          break;
+        case OR:
+          Emit (n.left, code, jt, next);
+          Emit (n.right, code, jt, jf);
+          break;
+        }
+    }
+
+    std::vector<std::string> m_tokens;
+    size_t m_pos = 0;
+    std::vector<Node> m_nodes;
+  };
+
+  std::vector<Insn> m_code;
+};
+
+} // namespace pcap
+
+#endif /* PACKET_FILTER_H */
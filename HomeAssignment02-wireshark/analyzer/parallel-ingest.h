@@ -0,0 +1,149 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Chunked multithreaded ingestion of a mapped capture.
+ *
+ * The file is cut into equal byte ranges and each cut is moved forward to
+ * the next position that looks like a record boundary: neither format has
+ * sync markers, so a run of consecutive records (or pcapng blocks) must
+ * have plausible headers and chain exactly. Finding the cuts only touches
+ * a few records per chunk. The chunks are then decoded by a pool of
+ * threads, each accumulating into its own State, and the caller merges the
+ * returned states.
+ *
+ * A guessed cut is confirmed afterwards: the previous chunk, walked from
+ * its own (confirmed) start, must end exactly on it. Packet bytes can
+ * mimic a chain of record headers, so when some chunk does not end on its
+ * successor's cut the states are thrown away and the file is decoded again
+ * in one chunk. That costs a second pass on such files only.
+ *
+ * pcapng section headers and interfaces must all come before the first
+ * packet (which is what capture tools write): a capture with a later
+ * section or interface block is rejected, read it with the sequential
+ * reader instead.
+ */
+
+#ifndef PARALLEL_INGEST_H
+#define PARALLEL_INGEST_H
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "pcap-reader.h"
+
+namespace pcap {
+
+namespace detail {
+
+/// First record boundary at or after offset, or end when none is found
+inline size_t
+Resync (const PcapReader &reader, size_t offset, size_t end)
+{
+  // pcapng blocks are 4-byte aligned, classic pcap records are not
+  size_t step = 1;
+  if (reader.IsPcapng ())
+    {
+      offset = (offset + 3) & ~static_cast<size_t> (3);
+      step = 4;
+    }
+  for (; offset < end; offset += step)
+    {
+      if (reader.IsBoundary (offset))
+        {
+          return offset;
+        }
+    }
+  return end;
+}
+
+} // namespace detail
+
+/**
+ * Decode the records of reader on threads workers. process (state, record)
+ * is called for every record; each worker owns one State, and the states
+ * are returned for the caller to merge. The reader is left untouched.
+ */
+template <typename State, typename Process>
+std::vector<State>
+ParallelIngest (const PcapReader &reader, unsigned threads, Process process)
+{
+  if (threads == 0)
+    {
+      threads = std::max (1u, std::thread::hardware_concurrency ());
+    }
+  const size_t start = reader.Tell ();
+  const size_t size = reader.File ().Size ();
+  const size_t chunks = std::max<size_t> (1, std::min<size_t> (threads * 8, (size - start) / (1 << 20)));
+
+  // Chunk boundaries; a cut that cannot be resynchronised folds into the previous chunk
+  std::vector<size_t> cuts (1, start);
+  for (size_t k = 1; k < chunks; ++k)
+    {
+      size_t cut = detail::Resync (reader, start + (size - start) / chunks * k, size);
+      if (cut > cuts.back ())
+        {
+          cuts.push_back (cut);
+        }
+    }
+  cuts.push_back (size);
+
+  while (true)
+    {
+      std::vector<State> states (threads);
+      std::vector<size_t> ends (cuts.size () - 1);
+      std::atomic<size_t> nextChunk (0);
+      std::atomic<bool> lateMeta (false);
+      std::vector<std::thread> workers;
+      for (unsigned t = 0; t < threads; ++t)
+        {
+          workers.push_back (std::thread ([&, t] {
+            State &state = states[t];
+            Record rec;
+            for (size_t k = nextChunk++; k + 1 < cuts.size (); k = nextChunk++)
+              {
+                size_t pos = cuts[k], next, unused;
+                bool packet, meta;
+                while (pos < cuts[k + 1] && (next = reader.RecordEnd (pos, packet, meta)) != 0)
+                  {
+                    if (meta)
+                      {
+                        lateMeta = true;
+                        break;
+                      }
+                    if (packet && reader.ParseAt (pos, rec, unused))
+                      {
+                        process (state, rec);
+                      }
+                    pos = next;
+                  }
+                ends[k] = pos;
+              }
+          }));
+        }
+      for (size_t t = 0; t < workers.size (); ++t)
+        {
+          workers[t].join ();
+        }
+      if (lateMeta)
+        {
+          throw std::runtime_error ("pcapng section or interface block after the first packet,"
+                                    " use the sequential reader");
+        }
+      bool confirmed = true;
+      for (size_t k = 0; k + 2 < cuts.size (); ++k)
+        {
+          confirmed = confirmed && ends[k] == cuts[k + 1];
+        }
+      if (confirmed)
+        {
+          return states;
+        }
+      cuts.assign (1, start);
+      cuts.push_back (size);
+    }
+}
+
+} // namespace pcap
+
+#endif /* PARALLEL_INGEST_H */
@@ -0,0 +1,217 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Screen captures for bad IPv4/TCP/UDP checksums, separating real
+ * corruption from checksum/segmentation offload artifacts (which are what
+ * Wireshark flags on most captures taken on the sending host). The sums
+ * use the SIMD kernels of checksum.h and the capture is checked in
+ * parallel chunks.
+ *
+ * Build: g++ -O2 -std=c++11 -pthread -o pcap-checksum pcap-checksum.cc
+ * Usage: ./pcap-checksum [-j threads] [-n shown] [-k scalar|sse2|avx2] [-Y filter] capture.pcap [...]
+ *   -Y  only check matching packets (see packet-filter.h)
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <getopt.h>
+#include "checksum.h"
+#include "packet-filter.h"
+#include "parallel-ingest.h"
+
+namespace {
+
+struct Bad
+{
+  uint64_t tsNs;
+  pcap::Packet pkt;
+  bool ip;               //!< the IPv4 header checksum is wrong (else the transport one)
+};
+
+struct State
+{
+  uint64_t packets = 0;
+  uint64_t bytes = 0;
+  uint64_t ip[4] = { 0, 0, 0, 0 };       //!< by ChecksumStatus
+  uint64_t l4[4] = { 0, 0, 0, 0 };
+  std::map<uint32_t, uint64_t> offloadSources;
+  std::vector<Bad> bad;                  //!< first few of each worker
+};
+
+size_t g_shown = 10;
+pcap::PacketFilter g_filter;
+
+void
+Process (State &state, const pcap::Record &rec)
+{
+  pcap::Packet pkt;
+  bool ip = pcap::Decode (rec.linkType, rec.data, rec.caplen, pkt);
+  if (!g_filter.Matches (rec, pkt, ip))
+    {
+      return;
+    }
+  state.packets++;
+  state.bytes += rec.caplen;
+  if (!ip)
+    {
+      return;
+    }
+  pcap::ChecksumResult r = pcap::VerifyChecksums (pkt, rec.data + rec.caplen);
+  state.ip[r.ip]++;
+  state.l4[r.l4]++;
+  if (r.ip == pcap::CSUM_OFFLOAD || r.l4 == pcap::CSUM_OFFLOAD)
+    {
+      state.offloadSources[pkt.src]++;
+    }
+  if ((r.ip == pcap::CSUM_BAD || r.l4 == pcap::CSUM_BAD) && state.bad.size () < g_shown)
+    {
+      Bad b = { rec.tsNs, pkt, r.ip == pcap::CSUM_BAD };
+      state.bad.push_back (b);
+    }
+}
+
+void
+Print (const char *what, const uint64_t *counts)
+{
+  std::cout << "  " << what << "ok " << counts[pcap::CSUM_OK] << ", bad " << counts[pcap::CSUM_BAD]
+            << ", offload " << counts[pcap::CSUM_OFFLOAD] << ", unchecked " << counts[pcap::CSUM_UNCHECKED] << "\n";
+}
+
+const char *
+KernelName (pcap::SumKernel kernel)
+{
+  switch (kernel)
+    {
+    case pcap::SUM_AVX2: return "avx2";
+    case pcap::SUM_SSE2: return "sse2";
+    default: return "scalar";
+    }
+}
+
+void
+Check (const std::string &path, unsigned threads)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+  pcap::PcapReader reader (path);
+  std::vector<State> states = pcap::ParallelIngest<State> (reader, threads, Process);
+  double elapsed = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+
+  State &total = states[0];
+  for (size_t i = 1; i < states.size (); ++i)
+    {
+      total.packets += states[i].packets;
+      total.bytes += states[i].bytes;
+      for (int s = 0; s < 4; ++s)
+        {
+          total.ip[s] += states[i].ip[s];
+          total.l4[s] += states[i].l4[s];
+        }
+      for (auto it = states[i].offloadSources.begin (); it != states[i].offloadSources.end (); ++it)
+        {
+          total.offloadSources[it->first] += it->second;
+        }
+      total.bad.insert (total.bad.end (), states[i].bad.begin (), states[i].bad.end ());
+    }
+  std::sort (total.bad.begin (), total.bad.end (), [] (const Bad &a, const Bad &b) { return a.tsNs < b.tsNs; });
+
+  std::cout << path << ": " << total.packets << " packets, " << reader.File ().Size () / elapsed / 1e6
+            << " MB/s (" << states.size () << " threads, " << KernelName (pcap::ActiveKernel ()) << ")\n";
+  Print ("IPv4 header: ", total.ip);
+  Print ("TCP/UDP:     ", total.l4);
+  for (auto it = total.offloadSources.begin (); it != total.offloadSources.end (); ++it)
+    {
+      std::cout << "  offload artifacts from " << pcap::FormatIpv4 (it->first) << ": " << it->second
+                << " (the capturing host)\n";
+    }
+  for (size_t i = 0; i < total.bad.size () && i < g_shown; ++i)
+    {
+      const pcap::Packet &p = total.bad[i].pkt;
+      std::cout << "  bad " << (total.bad[i].ip ? "IPv4 header" : p.proto == 6 ? "TCP" : "UDP") << " checksum at "
+                << std::fixed << std::setprecision (6) << total.bad[i].tsNs / 1e9 << ": " << pcap::FormatIpv4 (p.src) << ":" << p.sport << " -> "
+                << pcap::FormatIpv4 (p.dst) << ":" << p.dport << "\n";
+    }
+}
+
+void
+Usage (const char *name)
+{
+  std::cerr << "usage: " << name << " [-j threads] [-n shown] [-k scalar|sse2|avx2] [-Y filter] capture.pcap [...]\n";
+}
+
+} // namespace
+
+int
+main (int argc, char **argv)
+{
+  unsigned threads = 0;
+  pcap::SumKernel kernel = pcap::SUM_AUTO;
+  std::string expression;
+  int opt;
+  while ((opt = getopt (argc, argv, "j:n:k:Y:")) != -1)
+    {
+      switch (opt)
+        {
+        case 'j': threads = std::atoi (optarg); break;
+        case 'n': g_shown = std::strtoul (optarg, 0, 10); break;
+        case 'k':
+          if (std::string (optarg) == "scalar")
+            {
+              kernel = pcap::SUM_SCALAR;
+            }
+          else if (std::string (optarg) == "sse2")
+            {
+              kernel = pcap::SUM_SSE2;
+            }
+          else if (std::string (optarg) == "avx2")
+            {
+              kernel = pcap::SUM_AVX2;
+            }
+          else
+            {
+              Usage (argv[0]);
+              return 1;
+            }
+          break;
+        case 'Y': expression = optarg; break;
+        default:
+          Usage (argv[0]);
+          return 1;
+        }
+    }
+  if (optind >= argc)
+    {
+      Usage (argv[0]);
+      return 1;
+    }
+  // Before the workers start, so they do not race to pick one
+  pcap::SetSumKernel (kernel);
+  try
+    {
+      g_filter = pcap::PacketFilter (expression);
+    }
+  catch (const std::exception &e)
+    {
+      std::cerr << "error: " << e.what () << "\n";
+      return 1;
+    }
+
+  int status = 0;
+  for (int i = optind; i < argc; ++i)
+    {
+      try
+        {
+          Check (argv[i], threads);
+        }
+      catch (const std::exception &e)
+        {
+          std::cerr << "error: " << e.what () << "\n";
+          status = 1;
+        }
+    }
+  return status;
+}
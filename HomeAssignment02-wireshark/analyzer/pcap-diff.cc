@@ -0,0 +1,488 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Differential profile of two captures, e.g. with and without an
+ * application running: flows, endpoints and ports that carry traffic in
+ * only one of them, and the ports whose byte rate changed most.
+ *
+ * Each capture is read once. Flows (both directions together), endpoints
+ * (address, port, protocol) and ports (either end of a packet) are counted
+ * by bytes in space-saving tables of fixed capacity: when a table is full
+ * the entry with the fewest bytes is replaced, and the newcomer inherits
+ * its byte and packet counts as an error bound. Memory is therefore fixed whatever the
+ * capture size, heavy hitters are never lost, and a key missing from a
+ * table that has replaced entries carried at most that table's minimum
+ * count; such keys are reported with that bound instead of as absent.
+ * Rates are bytes over each capture's own duration.
+ *
+ * Build: g++ -O2 -std=c++11 -o pcap-diff pcap-diff.cc
+ * Usage: ./pcap-diff [-c capacity] [-n top] with.pcap without.pcap
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <getopt.h>
+#include "pcap-reader.h"
+
+namespace {
+
+/// Both directions of a flow; endpoint a is the lower (address, port)
+struct FlowKey
+{
+  uint32_t a;
+  uint32_t b;
+  uint16_t aport;
+  uint16_t bport;
+  uint8_t proto;
+
+  bool operator== (const FlowKey &o) const
+  {
+    return a == o.a && b == o.b && aport == o.aport && bport == o.bport && proto == o.proto;
+  }
+  uint64_t Hash () const
+  {
+    uint64_t h = (static_cast<uint64_t> (a) << 32 | b) * 0x9e3779b97f4a7c15ull;
+    h ^= (static_cast<uint64_t> (aport) << 24 | static_cast<uint64_t> (bport) << 8 | proto) * 0xc2b2ae3d27d4eb4full;
+    return h ^ (h >> 29);
+  }
+  std::string Format () const
+  {
+    return pcap::FormatIpv4 (a) + ":" + std::to_string (aport) + " <-> " + pcap::FormatIpv4 (b) + ":"
+           + std::to_string (bport) + " proto " + std::to_string (proto);
+  }
+};
+
+struct EndpointKey
+{
+  uint32_t addr;
+  uint16_t port;
+  uint8_t proto;
+
+  bool operator== (const EndpointKey &o) const
+  {
+    return addr == o.addr && port == o.port && proto == o.proto;
+  }
+  uint64_t Hash () const
+  {
+    uint64_t h = (static_cast<uint64_t> (addr) << 24 | static_cast<uint64_t> (port) << 8 | proto) * 0x9e3779b97f4a7c15ull;
+    return h ^ (h >> 29);
+  }
+  std::string Format () const
+  {
+    return pcap::FormatIpv4 (addr) + ":" + std::to_string (port) + " proto " + std::to_string (proto);
+  }
+};
+
+struct PortKey
+{
+  uint16_t port;
+  uint8_t proto;
+
+  bool operator== (const PortKey &o) const
+  {
+    return port == o.port && proto == o.proto;
+  }
+  uint64_t Hash () const
+  {
+    uint64_t h = (static_cast<uint64_t> (port) << 8 | proto) * 0x9e3779b97f4a7c15ull;
+    return h ^ (h >> 29);
+  }
+  std::string Format () const
+  {
+    return std::string (proto == 6 ? "tcp" : proto == 17 ? "udp" : "proto " + std::to_string (proto)) + "/"
+           + std::to_string (port);
+  }
+};
+
+/**
+ * Space-saving heavy hitter table: at most capacity keys, an open-addressing
+ * index (linear probing, backward-shift deletion) and a min-heap on bytes
+ * to find the entry to replace.
+ */
+template <typename Key>
+class SpaceSaving
+{
+public:
+  struct Entry
+  {
+    Key key;
+    uint64_t bytes;
+    uint64_t packets;
+    uint64_t error;      //!< bytes inherited from the replaced entry (upper bound of the overcount)
+    uint64_t packetError;  //!< packets inherited with them
+    uint32_t heapPos;
+  };
+
+  explicit SpaceSaving (size_t capacity)
+    : m_capacity (std::max<size_t> (capacity, 1)),
+      m_replaced (0)
+  {
+    size_t slots = 1;
+    while (slots < m_capacity * 2)
+      {
+        slots *= 2;
+      }
+    m_index.assign (slots, static_cast<uint32_t> (EMPTY));
+    m_entries.reserve (m_capacity);
+    m_heap.reserve (m_capacity);
+  }
+
+  void Add (const Key &key, uint32_t bytes)
+  {
+    size_t slot = Lookup (key);
+    uint32_t e = m_index[slot];
+    if (e != EMPTY)
+      {
+        m_entries[e].bytes += bytes;
+        m_entries[e].packets++;
+        SiftDown (m_entries[e].heapPos);
+        return;
+      }
+    if (m_entries.size () < m_capacity)
+      {
+        Entry n = { key, bytes, 1, 0, 0, static_cast<uint32_t> (m_heap.size ()) };
+        m_entries.push_back (n);
+        m_index[slot] = m_entries.size () - 1;
+        m_heap.push_back (m_entries.size () - 1);
+        SiftUp (m_heap.size () - 1);
+        return;
+      }
+    // Replace the smallest entry; the newcomer may have had up to its bytes before
+    e = m_heap[0];
+    Entry &victim = m_entries[e];
+    Erase (Lookup (victim.key));
+    m_replaced++;
+    victim.key = key;
+    victim.error = victim.bytes;
+    victim.bytes += bytes;
+    victim.packetError = victim.packets;
+    victim.packets++;
+    m_index[Lookup (key)] = e;
+    SiftDown (0);
+  }
+
+  const Entry *Find (const Key &key) const
+  {
+    uint32_t e = m_index[Lookup (key)];
+    return e == EMPTY ? 0 : &m_entries[e];
+  }
+
+  /// Upper bound of the bytes of a key that is not in the table (0 if nothing was replaced)
+  uint64_t Floor () const
+  {
+    return m_replaced ? m_entries[m_heap[0]].bytes : 0;
+  }
+  uint64_t Replaced () const
+  {
+    return m_replaced;
+  }
+  const std::vector<Entry> &Entries () const
+  {
+    return m_entries;
+  }
+
+private:
+  static const uint32_t EMPTY = ~0u;
+
+  size_t Lookup (const Key &key) const
+  {
+    size_t mask = m_index.size () - 1;
+    size_t slot = key.Hash () & mask;
+    while (m_index[slot] != EMPTY && !(m_entries[m_index[slot]].key == key))
+      {
+        slot = (slot + 1) & mask;
+      }
+    return slot;
+  }
+
+  /// Empty slot and move later entries of the probe run back so that lookups still find them
+  void Erase (size_t slot)
+  {
+    size_t mask = m_index.size () - 1;
+    m_index[slot] = EMPTY;
+    for (size_t next = (slot + 1) & mask; m_index[next] != EMPTY; next = (next + 1) & mask)
+      {
+        size_t home = m_entries[m_index[next]].key.Hash () & mask;
+        // Move it if its home is not within (slot, next]
+        if (((next - home) & mask) >= ((next - slot) & mask))
+          {
+            m_index[slot] = m_index[next];
+            m_index[next] = EMPTY;
+            slot = next;
+          }
+      }
+  }
+
+  void Swap (size_t i, size_t j)
+  {
+    std::swap (m_heap[i], m_heap[j]);
+    m_entries[m_heap[i]].heapPos = i;
+    m_entries[m_heap[j]].heapPos = j;
+  }
+
+  void SiftUp (size_t i)
+  {
+    while (i > 0 && m_entries[m_heap[(i - 1) / 2]].bytes > m_entries[m_heap[i]].bytes)
+      {
+        Swap (i, (i - 1) / 2);
+        i = (i - 1) / 2;
+      }
+  }
+
+  void SiftDown (size_t i)
+  {
+    while (true)
+      {
+        size_t least = i;
+        for (size_t c = 2 * i + 1; c <= 2 * i + 2 && c < m_heap.size (); ++c)
+          {
+            if (m_entries[m_heap[c]].bytes < m_entries[m_heap[least]].bytes)
+              {
+                least = c;
+              }
+          }
+        if (least == i)
+          {
+            return;
+          }
+        Swap (i, least);
+        i = least;
+      }
+  }
+
+  size_t m_capacity;
+  uint64_t m_replaced;
+  std::vector<uint32_t> m_index;         //!< entry per slot
+  std::vector<Entry> m_entries;
+  std::vector<uint32_t> m_heap;          //!< entries ordered as a min-heap on bytes
+};
+
+struct Profile
+{
+  explicit Profile (size_t capacity)
+    : flows (capacity),
+      endpoints (capacity),
+      ports (capacity)
+  {
+  }
+
+  std::string path;
+  uint64_t packets = 0;
+  uint64_t bytes = 0;
+  uint64_t nonIp = 0;
+  uint64_t first = ~0ull;
+  uint64_t last = 0;
+  SpaceSaving<FlowKey> flows;
+  SpaceSaving<EndpointKey> endpoints;
+  SpaceSaving<PortKey> ports;
+
+  double Duration () const
+  {
+    return last > first ? (last - first) / 1e9 : 0;
+  }
+  /// kbit/s over the capture duration
+  double Rate (uint64_t b) const
+  {
+    return Duration () > 0 ? b * 8 / Duration () / 1e3 : 0;
+  }
+};
+
+void
+Read (Profile &p)
+{
+  pcap::PcapReader reader (p.path);
+  pcap::Record rec;
+  pcap::Packet pkt;
+  while (reader.Next (rec))
+    {
+      p.packets++;
+      p.bytes += rec.len;
+      p.first = std::min (p.first, rec.tsNs);
+      p.last = std::max (p.last, rec.tsNs);
+      if (!pcap::Decode (rec.linkType, rec.data, rec.caplen, pkt))
+        {
+          p.nonIp++;
+          continue;
+        }
+      bool reversed = pkt.src > pkt.dst || (pkt.src == pkt.dst && pkt.sport > pkt.dport);
+      FlowKey flow = { reversed ? pkt.dst : pkt.src, reversed ? pkt.src : pkt.dst,
+                       reversed ? pkt.dport : pkt.sport, reversed ? pkt.sport : pkt.dport, pkt.proto };
+      p.flows.Add (flow, rec.len);
+      EndpointKey src = { pkt.src, pkt.sport, pkt.proto };
+      EndpointKey dst = { pkt.dst, pkt.dport, pkt.proto };
+      p.endpoints.Add (src, rec.len);
+      p.endpoints.Add (dst, rec.len);
+      PortKey sport = { pkt.sport, pkt.proto };
+      PortKey dport = { pkt.dport, pkt.proto };
+      p.ports.Add (sport, rec.len);
+      if (!(dport == sport))
+        {
+          p.ports.Add (dport, rec.len);
+        }
+    }
+}
+
+/// Keys of mine missing from other's table, by bytes; at most top of them
+template <typename Key>
+void
+PrintOnlyIn (const std::string &what, const Profile &mine, const SpaceSaving<Key> &table,
+             const SpaceSaving<Key> &otherTable, size_t top)
+{
+  std::vector<const typename SpaceSaving<Key>::Entry *> only;
+  for (size_t i = 0; i < table.Entries ().size (); ++i)
+    {
+      if (!otherTable.Find (table.Entries ()[i].key))
+        {
+          only.push_back (&table.Entries ()[i]);
+        }
+    }
+  std::sort (only.begin (), only.end (),
+             [] (const typename SpaceSaving<Key>::Entry *a, const typename SpaceSaving<Key>::Entry *b) {
+               return a->bytes > b->bytes;
+             });
+  std::cout << "\n" << what << " only in " << mine.path << ": " << only.size ();
+  if (otherTable.Floor ())
+    {
+      std::cout << " (table of the other capture is full: up to " << otherTable.Floor () << " bytes there)";
+    }
+  std::cout << "\n";
+  for (size_t i = 0; i < only.size () && i < top; ++i)
+    {
+      std::cout << "  " << std::left << std::setw (52) << only[i]->key.Format () << std::right
+                << std::setw (12) << only[i]->bytes << " bytes " << std::setw (8) << only[i]->packets
+                << " packets " << std::setw (10) << mine.Rate (only[i]->bytes) << " kbit/s";
+      if (only[i]->error)
+        {
+          std::cout << " (+-" << only[i]->error << " bytes, +-" << only[i]->packetError << " packets)";
+        }
+      std::cout << "\n";
+    }
+}
+
+/// Ports seen in both captures with the largest change in byte rate
+void
+PrintRateChanges (const Profile &a, const Profile &b, size_t top)
+{
+  struct Change
+  {
+    PortKey key;
+    double rateA;
+    double rateB;
+  };
+  std::vector<Change> changes;
+  for (size_t i = 0; i < a.ports.Entries ().size (); ++i)
+    {
+      const SpaceSaving<PortKey>::Entry &e = a.ports.Entries ()[i];
+      const SpaceSaving<PortKey>::Entry *o = b.ports.Find (e.key);
+      if (o)
+        {
+          Change c = { e.key, a.Rate (e.bytes), b.Rate (o->bytes) };
+          changes.push_back (c);
+        }
+    }
+  std::sort (changes.begin (), changes.end (), [] (const Change &x, const Change &y) {
+    return std::abs (x.rateA - x.rateB) > std::abs (y.rateA - y.rateB);
+  });
+  std::cout << "\nPorts in both, largest rate change (kbit/s " << a.path << " -> " << b.path << ")\n";
+  for (size_t i = 0; i < changes.size () && i < top; ++i)
+    {
+      std::cout << "  " << std::left << std::setw (16) << changes[i].key.Format () << std::right
+                << std::setw (12) << changes[i].rateA << " -> " << std::setw (12) << changes[i].rateB << "\n";
+    }
+}
+
+/// Whole decimal number for -c and -n
+bool
+ParseCount (const char *text, size_t &value)
+{
+  char *end;
+  unsigned long v = std::strtoul (text, &end, 10);
+  if (!*text || *text == '-' || *end)
+    {
+      return false;
+    }
+  value = v;
+  return true;
+}
+
+void
+Usage (const char *name)
+{
+  std::cerr << "usage: " << name << " [-c capacity] [-n top] with.pcap without.pcap\n";
+}
+
+} // namespace
+
+int
+main (int argc, char **argv)
+{
+  size_t capacity = 65536;
+  size_t top = 15;
+  int opt;
+  while ((opt = getopt (argc, argv, "c:n:")) != -1)
+    {
+      switch (opt)
+        {
+        case 'c':
+          if (!ParseCount (optarg, capacity))
+            {
+              Usage (argv[0]);
+              return 1;
+            }
+          break;
+        case 'n':
+          if (!ParseCount (optarg, top))
+            {
+              Usage (argv[0]);
+              return 1;
+            }
+          break;
+        default:
+          Usage (argv[0]);
+          return 1;
+        }
+    }
+  if (optind != argc - 2)
+    {
+      Usage (argv[0]);
+      return 1;
+    }
+
+  try
+    {
+      Profile a (capacity), b (capacity);
+      a.path = argv[optind];
+      b.path = argv[optind + 1];
+      Read (a);
+      Read (b);
+      std::cout << std::fixed << std::setprecision (1);
+      for (const Profile *p : { &a, &b })
+        {
+          std::cout << p->path << ": " << p->packets << " packets, " << p->bytes << " bytes, "
+                    << p->Duration () << " s, " << p->Rate (p->bytes) << " kbit/s, " << p->nonIp << " non-IPv4, "
+                    << p->flows.Entries ().size () << " flows";
+          if (p->flows.Replaced ())
+            {
+              std::cout << " (" << p->flows.Replaced () << " replaced)";
+            }
+          std::cout << "\n";
+        }
+      PrintOnlyIn ("Flows", a, a.flows, b.flows, top);
+      PrintOnlyIn ("Flows", b, b.flows, a.flows, top);
+      PrintOnlyIn ("Ports", a, a.ports, b.ports, top);
+      PrintOnlyIn ("Ports", b, b.ports, a.ports, top);
+      PrintOnlyIn ("Endpoints", a, a.endpoints, b.endpoints, top);
+      PrintOnlyIn ("Endpoints", b, b.endpoints, a.endpoints, top);
+      PrintRateChanges (a, b, top);
+    }
+  catch (const std::exception &e)
+    {
+      std::cerr << "error: " << e.what () << "\n";
+      return 1;
+    }
+  return 0;
+}
@@ -0,0 +1,234 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Sidecar index of a pcap/pcapng capture for time range and flow queries.
+ *
+ * The index is built once with a sequential walk and stored next to the
+ * capture as <capture>.idx. It holds, sorted by timestamp, the file offset,
+ * timestamp and a direction-independent five-tuple hash of every record,
+ * plus the offsets of the pcapng section header and interface blocks, so a
+ * record can be decoded straight from its offset with the right byte order,
+ * link type and timestamp resolution. A query binary-searches the time
+ * range and only touches the matching records of the capture.
+ *
+ *   char    magic[8]   "PCAPIDX1"
+ *   uint64  capture size, capture mtime (ns)   -- the index is rebuilt when they change
+ *   uint64  meta blocks, entries
+ *   uint64  meta block offsets[meta blocks]
+ *   entries { uint64 offset; uint64 tsNs; uint32 flowHash (0 = not IPv4); uint32 meta blocks before it }
+ */
+
+#ifndef PCAP_INDEX_H
+#define PCAP_INDEX_H
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include "pcap-reader.h"
+
+namespace pcap {
+
+/// Five-tuple hash that is the same for both directions of a flow; never 0
+inline uint32_t
+FlowHash (uint32_t src, uint16_t sport, uint32_t dst, uint16_t dport, uint8_t proto)
+{
+  uint64_t a = static_cast<uint64_t> (src) << 16 | sport;
+  uint64_t b = static_cast<uint64_t> (dst) << 16 | dport;
+  if (a > b)
+    {
+      std::swap (a, b);
+    }
+  uint64_t h = (a * 0x9e3779b97f4a7c15ull) ^ ((b << 8 | proto) * 0xc2b2ae3d27d4eb4full);
+  h ^= h >> 29;
+  return static_cast<uint32_t> (h ^ (h >> 32)) | 1;
+}
+
+inline uint32_t
+FlowHash (const Packet &pkt)
+{
+  return FlowHash (pkt.src, pkt.sport, pkt.dst, pkt.dport, pkt.proto);
+}
+
+class CaptureIndex
+{
+public:
+  struct Entry
+  {
+    uint64_t offset;
+    uint64_t tsNs;
+    uint32_t flowHash;
+    uint32_t meta;       //!< number of meta blocks that precede the record
+  };
+
+  /**
+   * Load the sidecar index of capture, building (and saving) it first if
+   * it is missing, stale or rebuild is set. A sidecar that cannot be
+   * written is not an error; the index is then only kept in memory.
+   */
+  CaptureIndex (PcapReader &reader, const std::string &capture, bool rebuild = false)
+    : m_path (capture + ".idx"),
+      m_built (false)
+  {
+    struct stat st;
+    if (stat (capture.c_str (), &st) < 0)
+      {
+        throw std::runtime_error ("cannot stat " + capture);
+      }
+    m_size = st.st_size;
+    m_mtime = st.st_mtim.tv_sec * 1000000000ull + st.st_mtim.tv_nsec;
+    if (rebuild || !Load ())
+      {
+        Build (reader);
+        Save ();
+        m_built = true;
+      }
+  }
+
+  const std::string &Path () const
+  {
+    return m_path;
+  }
+  /// True if the index was built by the constructor rather than loaded
+  bool Built () const
+  {
+    return m_built;
+  }
+  const std::vector<Entry> &Entries () const
+  {
+    return m_entries;
+  }
+
+  /**
+   * Call f (record) for every record with fromNs <= timestamp < toNs, in
+   * timestamp order. Unless flowHashes is empty only records with one of
+   * those flow hashes are passed (the caller still has to compare the
+   * five-tuple).
+   */
+  template <typename F>
+  uint64_t Query (PcapReader &reader, uint64_t fromNs, uint64_t toNs, const std::vector<uint32_t> &flowHashes, F f)
+  {
+    Entry key = { 0, fromNs, 0, 0 };
+    std::vector<Entry>::const_iterator it
+      = std::lower_bound (m_entries.begin (), m_entries.end (), key,
+                          [] (const Entry &a, const Entry &b) { return a.tsNs < b.tsNs; });
+    uint64_t visited = 0;
+    Record rec;
+    for (; it != m_entries.end () && it->tsNs < toNs; ++it)
+      {
+        if (!flowHashes.empty ()
+            && std::find (flowHashes.begin (), flowHashes.end (), it->flowHash) == flowHashes.end ())
+          {
+            continue;
+          }
+        Restore (reader, it->meta);
+        size_t next;
+        if (reader.ParseAt (it->offset, rec, next))
+          {
+            visited++;
+            f (rec);
+          }
+      }
+    return visited;
+  }
+
+private:
+  bool Load ()
+  {
+    std::ifstream in (m_path.c_str (), std::ios::binary);
+    char magic[8];
+    uint64_t header[4];
+    if (!in.read (magic, 8) || std::string (magic, 8) != "PCAPIDX1"
+        || !in.read (reinterpret_cast<char *> (header), sizeof (header))
+        || header[0] != m_size || header[1] != m_mtime)
+      {
+        return false;
+      }
+    m_meta.resize (header[2]);
+    m_entries.resize (header[3]);
+    in.read (reinterpret_cast<char *> (m_meta.data ()), m_meta.size () * sizeof (uint64_t));
+    in.read (reinterpret_cast<char *> (m_entries.data ()), m_entries.size () * sizeof (Entry));
+    return static_cast<bool> (in);
+  }
+
+  void Build (PcapReader &reader)
+  {
+    m_meta.clear ();
+    m_entries.clear ();
+    reader.Seek (0);
+    Packet pkt;
+    reader.Scan ([&] (size_t offset) {
+                   Record rec;
+                   size_t next;
+                   if (!reader.ParseAt (offset, rec, next))
+                     {
+                       return;
+                     }
+                   Entry e = { offset, rec.tsNs, 0, static_cast<uint32_t> (m_meta.size ()) };
+                   if (Decode (rec.linkType, rec.data, rec.caplen, pkt))
+                     {
+                       e.flowHash = FlowHash (pkt);
+                     }
+                   m_entries.push_back (e);
+                 },
+                 [&] (size_t offset) { m_meta.push_back (offset); });
+    std::stable_sort (m_entries.begin (), m_entries.end (),
+                      [] (const Entry &a, const Entry &b) { return a.tsNs < b.tsNs; });
+    m_loaded = m_meta.size ();
+  }
+
+  void Save () const
+  {
+    std::string tmp = m_path + ".tmp";
+    std::ofstream out (tmp.c_str (), std::ios::binary);
+    uint64_t header[4] = { m_size, m_mtime, m_meta.size (), m_entries.size () };
+    out.write ("PCAPIDX1", 8);
+    out.write (reinterpret_cast<const char *> (header), sizeof (header));
+    out.write (reinterpret_cast<const char *> (m_meta.data ()), m_meta.size () * sizeof (uint64_t));
+    out.write (reinterpret_cast<const char *> (m_entries.data ()), m_entries.size () * sizeof (Entry));
+    out.close ();
+    if (!out || std::rename (tmp.c_str (), m_path.c_str ()) != 0)
+      {
+        std::remove (tmp.c_str ());
+      }
+  }
+
+  /// Bring the reader's pcapng section state to the one after the first meta blocks
+  void Restore (PcapReader &reader, uint32_t meta)
+  {
+    if (meta == m_loaded || !reader.IsPcapng ())
+      {
+        return;
+      }
+    // Replay from the last section header at or before the wanted state
+    uint32_t first = meta;
+    while (first > 0 && !IsSectionHeader (reader, m_meta[first - 1]))
+      {
+        first--;
+      }
+    first = first > 0 ? first - 1 : 0;
+    reader.LoadBlocks (m_meta.data () + first, meta - first);
+    m_loaded = meta;
+  }
+
+  static bool IsSectionHeader (const PcapReader &reader, uint64_t offset)
+  {
+    uint32_t type;
+    std::memcpy (&type, reader.File ().Data () + offset, 4);
+    return type == PcapReader::BLOCK_SECTION_HEADER;
+  }
+
+  std::string m_path;
+  uint64_t m_size;
+  uint64_t m_mtime;
+  bool m_built;
+  uint32_t m_loaded = ~0u;               //!< meta blocks the reader's section state corresponds to
+  std::vector<uint64_t> m_meta;          //!< offsets of pcapng section header and interface blocks
+  std::vector<Entry> m_entries;          //!< sorted by timestamp
+};
+
+} // namespace pcap
+
+#endif /* PCAP_INDEX_H */
@@ -0,0 +1,217 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Time range and flow queries on a capture through its sidecar index
+ * (see pcap-index.h). The first query builds <capture>.idx; later ones
+ * only read the index and the matching records.
+ *
+ * Build: g++ -O2 -std=c++11 -o pcap-query pcap-query.cc
+ * Usage: ./pcap-query [-r] [-c] [-t from:to] [-f addr:port-addr:port[/proto]] [-Y filter] capture
+ *   -t  seconds since the first record, either end may be left out
+ *   -f  both directions of one flow; proto is tcp, udp or a number (default any)
+ *   -Y  only matching records (see packet-filter.h); applied after -t and -f
+ *   -c  only print the number of matching records
+ *   -r  rebuild the index even if it is up to date
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <arpa/inet.h>
+#include <getopt.h>
+#include "packet-filter.h"
+#include "pcap-index.h"
+
+namespace {
+
+struct FlowFilter
+{
+  uint32_t a = 0;
+  uint32_t b = 0;
+  uint16_t aport = 0;
+  uint16_t bport = 0;
+  int proto = -1;
+
+  bool Matches (const pcap::Packet &pkt) const
+  {
+    if (proto >= 0 && pkt.proto != proto)
+      {
+        return false;
+      }
+    return (pkt.src == a && pkt.sport == aport && pkt.dst == b && pkt.dport == bport)
+           || (pkt.src == b && pkt.sport == bport && pkt.dst == a && pkt.dport == aport);
+  }
+};
+
+/// Whole decimal number up to max; what names it in the error
+unsigned long
+ParseNumber (const std::string &text, unsigned long max, const char *what)
+{
+  char *end;
+  unsigned long v = std::strtoul (text.c_str (), &end, 10);
+  if (text.empty () || text[0] == '-' || *end || v > max)
+    {
+      throw std::runtime_error (std::string ("bad ") + what + " " + text);
+    }
+  return v;
+}
+
+/// Seconds since the first record for -t
+double
+ParseSeconds (const std::string &text)
+{
+  char *end;
+  double v = std::strtod (text.c_str (), &end);
+  if (text.empty () || *end || !(v >= 0))
+    {
+      throw std::runtime_error ("bad time " + text + ", expected seconds since the first record");
+    }
+  return v;
+}
+
+void
+ParseEndpoint (const std::string &text, uint32_t &addr, uint16_t &port)
+{
+  size_t colon = text.rfind (':');
+  struct in_addr in;
+  if (colon == std::string::npos || inet_pton (AF_INET, text.substr (0, colon).c_str (), &in) != 1)
+    {
+      throw std::runtime_error ("bad endpoint " + text + ", expected addr:port");
+    }
+  addr = ntohl (in.s_addr);
+  port = static_cast<uint16_t> (ParseNumber (text.substr (colon + 1), 65535, "port"));
+}
+
+FlowFilter
+ParseFlow (const std::string &text)
+{
+  FlowFilter f;
+  std::string endpoints = text;
+  size_t slash = text.find ('/');
+  if (slash != std::string::npos)
+    {
+      std::string proto = text.substr (slash + 1);
+      f.proto = proto == "tcp" ? 6 : proto == "udp" ? 17 : static_cast<int> (ParseNumber (proto, 255, "protocol"));
+      endpoints = text.substr (0, slash);
+    }
+  size_t dash = endpoints.find ('-');
+  if (dash == std::string::npos)
+    {
+      throw std::runtime_error ("bad flow " + text + ", expected addr:port-addr:port[/proto]");
+    }
+  ParseEndpoint (endpoints.substr (0, dash), f.a, f.aport);
+  ParseEndpoint (endpoints.substr (dash + 1), f.b, f.bport);
+  return f;
+}
+
+void
+Usage (const char *name)
+{
+  std::cerr << "usage: " << name << " [-r] [-c] [-t from:to] [-f addr:port-addr:port[/proto]] [-Y filter] capture\n";
+}
+
+} // namespace
+
+int
+main (int argc, char **argv)
+{
+  bool rebuild = false, countOnly = false;
+  std::string range, flow, expression;
+  int opt;
+  while ((opt = getopt (argc, argv, "rct:f:Y:")) != -1)
+    {
+      switch (opt)
+        {
+        case 'r': rebuild = true; break;
+        case 'c': countOnly = true; break;
+        case 't': range = optarg; break;
+        case 'f': flow = optarg; break;
+        case 'Y': expression = optarg; break;
+        default:
+          Usage (argv[0]);
+          return 1;
+        }
+    }
+  if (optind != argc - 1)
+    {
+      Usage (argv[0]);
+      return 1;
+    }
+
+  try
+    {
+      pcap::PacketFilter expr (expression);
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+      pcap::PcapReader reader (argv[optind]);
+      pcap::CaptureIndex index (reader, argv[optind], rebuild);
+      double indexTime = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+      std::cerr << (index.Built () ? "built " : "loaded ") << index.Path () << ": "
+                << index.Entries ().size () << " records in " << indexTime << " s\n";
+      if (index.Entries ().empty ())
+        {
+          return 0;
+        }
+
+      // Record times are relative to the first record of the capture
+      uint64_t base = index.Entries ().front ().tsNs;
+      uint64_t from = 0, to = ~0ull;
+      if (!range.empty ())
+        {
+          size_t colon = range.find (':');
+          std::string lo = range.substr (0, colon);
+          std::string hi = colon == std::string::npos ? "" : range.substr (colon + 1);
+          from = lo.empty () ? 0 : base + static_cast<uint64_t> (ParseSeconds (lo) * 1e9);
+          to = hi.empty () ? ~0ull : base + static_cast<uint64_t> (ParseSeconds (hi) * 1e9);
+        }
+      FlowFilter filter;
+      std::vector<uint32_t> hashes;
+      if (!flow.empty ())
+        {
+          filter = ParseFlow (flow);
+          // The index hash covers the protocol, so an open protocol needs the TCP
+          // and UDP candidates; other protocols have no ports, so with both
+          // ports 0 every entry is read
+          if (filter.proto >= 0)
+            {
+              hashes.push_back (pcap::FlowHash (filter.a, filter.aport, filter.b, filter.bport, filter.proto));
+            }
+          else if (filter.aport || filter.bport)
+            {
+              hashes.push_back (pcap::FlowHash (filter.a, filter.aport, filter.b, filter.bport, 6));
+              hashes.push_back (pcap::FlowHash (filter.a, filter.aport, filter.b, filter.bport, 17));
+            }
+        }
+
+      uint64_t matched = 0;
+      pcap::Packet pkt;
+      start = std::chrono::steady_clock::now ();
+      uint64_t visited = index.Query (reader, from, to, hashes, [&] (const pcap::Record &rec) {
+        bool ip = pcap::Decode (rec.linkType, rec.data, rec.caplen, pkt);
+        if ((!flow.empty () && (!ip || !filter.Matches (pkt))) || !expr.Matches (rec, pkt, ip))
+          {
+            return;
+          }
+        matched++;
+        if (countOnly)
+          {
+            return;
+          }
+        std::cout << std::fixed << std::setprecision (6) << (rec.tsNs - base) / 1e9 << "  " << rec.len;
+        if (ip)
+          {
+            std::cout << "  " << pcap::FormatIpv4 (pkt.src) << ":" << pkt.sport << " -> "
+                      << pcap::FormatIpv4 (pkt.dst) << ":" << pkt.dport << " proto " << unsigned (pkt.proto);
+          }
+        std::cout << "\n";
+      });
+      double queryTime = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+      std::cout << matched << " matching records\n";
+      std::cerr << visited << " records read in " << queryTime << " s\n";
+    }
+  catch (const std::exception &e)
+    {
+      std::cerr << "error: " << e.what () << "\n";
+      return 1;
+    }
+  return 0;
+}
@@ -0,0 +1,778 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Memory-mapped, zero-copy reader for pcap and pcapng captures.
+ *
+ * The whole capture is mmapped read-only and records are walked in place:
+ * a Record only points into the mapping, and Decode () fills a Packet with
+ * pointers to and fields from the Ethernet/IPv4/TCP/UDP headers without
+ * copying the frame. Both byte orders and the microsecond and nanosecond
+ * variants of the format are supported.
+ */
+
+#ifndef PCAP_READER_H
+#define PCAP_READER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace pcap {
+
+/// Link types we know how to decode
+enum LinkType
+{
+  LINKTYPE_ETHERNET = 1,
+  LINKTYPE_RAW = 101,
+  LINKTYPE_IEEE802_11 = 105,
+  LINKTYPE_LINUX_SLL = 113
+};
+
+inline uint16_t
+Load16 (const uint8_t *p)
+{
+  return static_cast<uint16_t> ((p[0] << 8) | p[1]);
+}
+
+/// Big-endian (network order) 32-bit field; compilers turn this into a load and a byte swap
+inline uint32_t
+Load32 (const uint8_t *p)
+{
+  return (static_cast<uint32_t> (p[0]) << 24) | (static_cast<uint32_t> (p[1]) << 16)
+         | (static_cast<uint32_t> (p[2]) << 8) | p[3];
+}
+
+/// Read-only mapping of a whole file, unmapped on destruction
+class MappedFile
+{
+public:
+  explicit MappedFile (const std::string &path)
+    : m_data (0),
+      m_size (0)
+  {
+    int fd = open (path.c_str (), O_RDONLY);
+    if (fd < 0)
+      {
+        throw std::runtime_error ("cannot open " + path);
+      }
+    struct stat st;
+    if (fstat (fd, &st) < 0)
+      {
+        close (fd);
+        throw std::runtime_error ("cannot stat " + path);
+      }
+    m_size = st.st_size;
+    if (m_size > 0)
+      {
+        void *map = mmap (0, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+          {
+            close (fd);
+            throw std::runtime_error ("cannot mmap " + path);
+          }
+        m_data = static_cast<const uint8_t *> (map);
+        madvise (map, m_size, MADV_SEQUENTIAL);
+      }
+    close (fd);
+  }
+
+  ~MappedFile ()
+  {
+    if (m_data)
+      {
+        munmap (const_cast<uint8_t *> (m_data), m_size);
+      }
+  }
+
+  const uint8_t *Data () const
+  {
+    return m_data;
+  }
+  size_t Size () const
+  {
+    return m_size;
+  }
+
+private:
+  MappedFile (const MappedFile &);
+  MappedFile &operator= (const MappedFile &);
+
+  const uint8_t *m_data;
+  size_t m_size;
+};
+
+/// One capture record, pointing into the mapping
+struct Record
+{
+  uint64_t tsNs;       //!< timestamp in nanoseconds since the epoch
+  uint32_t caplen;     //!< bytes present in data
+  uint32_t len;        //!< original length on the wire
+  uint32_t linkType;   //!< link type of the interface the record was captured on
+  uint32_t interface;  //!< pcapng interface id, 0 for classic pcap
+  const uint8_t *data;
+};
+
+/// Capture interface: link type and timestamp resolution (pcapng IDB)
+struct Interface
+{
+  uint32_t linkType;
+  uint32_t snaplen;
+  uint64_t unitsPerSec;  //!< timestamp ticks per second (if_tsresol)
+  uint64_t nsPerUnit;    //!< 1e9 / unitsPerSec when exact, else 0
+  int64_t offsetSec;     //!< if_tsoffset
+
+  uint64_t ToNs (uint64_t ts) const
+  {
+    if (nsPerUnit)
+      {
+        return ts * nsPerUnit + offsetSec * 1000000000ll;
+      }
+    return static_cast<uint64_t> (static_cast<unsigned __int128> (ts) * 1000000000u / unitsPerSec)
+           + offsetSec * 1000000000ll;
+  }
+};
+
+/**
+ * Sequential walker over the records of a mapped capture. Classic pcap and
+ * pcapng (several sections and interfaces, per-interface link type and
+ * timestamp resolution) are both supported; the format is detected from the
+ * magic number.
+ */
+class PcapReader
+{
+public:
+  explicit PcapReader (const std::string &path)
+    : m_file (path),
+      m_pos (HEADER_SIZE),
+      m_ng (false),
+      m_swap (false)
+  {
+    if (m_file.Size () < 4)
+      {
+        throw std::runtime_error (path + ": too short for a capture header");
+      }
+    uint32_t magic;
+    std::memcpy (&magic, m_file.Data (), 4);
+    bool nanos = false;
+    switch (magic)
+      {
+      case 0xa1b2c3d4: m_swap = false; break;
+      case 0xd4c3b2a1: m_swap = true; break;
+      case 0xa1b23c4d: m_swap = false; nanos = true; break;
+      case 0x4d3cb2a1: m_swap = true; nanos = true; break;
+      case BLOCK_SECTION_HEADER:
+        m_ng = true;
+        break;
+      default:
+        throw std::runtime_error (path + ": not a pcap or pcapng file");
+      }
+    if (m_ng)
+      {
+        // Register the section header and interfaces that precede the first packet
+        m_pos = 0;
+        size_t next;
+        uint32_t type;
+        while (BlockAt (m_pos, type, next) && !IsPacketBlock (type))
+          {
+            HandleBlock (m_pos, type);
+            m_pos = next;
+          }
+        if (m_interfaces.empty ())
+          {
+            throw std::runtime_error (path + ": pcapng without an interface description");
+          }
+        return;
+      }
+    if (m_file.Size () < HEADER_SIZE)
+      {
+        throw std::runtime_error (path + ": too short for a pcap header");
+      }
+    Interface iface;
+    iface.snaplen = Field (m_file.Data () + 16);
+    iface.linkType = Field (m_file.Data () + 20) & 0x0fffffff;
+    iface.unitsPerSec = nanos ? 1000000000 : 1000000;
+    iface.nsPerUnit = nanos ? 1 : 1000;
+    iface.offsetSec = 0;
+    m_interfaces.push_back (iface);
+  }
+
+  /// Link type of the first interface
+  uint32_t LinkType () const
+  {
+    return m_interfaces[0].linkType;
+  }
+  uint32_t Snaplen () const
+  {
+    return m_interfaces[0].snaplen;
+  }
+  bool IsPcapng () const
+  {
+    return m_ng;
+  }
+  const std::vector<Interface> &Interfaces () const
+  {
+    return m_interfaces;
+  }
+  const MappedFile &File () const
+  {
+    return m_file;
+  }
+
+  /// Offset of the next record (block) in the file
+  size_t Tell () const
+  {
+    return m_pos;
+  }
+  /// Continue reading at a record boundary previously returned by Tell ()
+  void Seek (size_t offset)
+  {
+    m_pos = !m_ng && offset < HEADER_SIZE ? static_cast<size_t> (HEADER_SIZE) : offset;
+  }
+
+  /// Read the next record; false at the end of the file or on a truncated record
+  bool Next (Record &record)
+  {
+    if (!m_ng)
+      {
+        return ParseAt (m_pos, record, m_pos);
+      }
+    uint32_t type;
+    size_t next;
+    while (BlockAt (m_pos, type, next))
+      {
+        size_t offset = m_pos;
+        m_pos = next;
+        if (IsPacketBlock (type))
+          {
+            if (PacketAt (offset, type, record))
+              {
+                return true;
+              }
+          }
+        else
+          {
+            HandleBlock (offset, type);
+          }
+      }
+    return false;
+  }
+
+  /**
+   * Parse the first record at or after offset and set next to the offset
+   * following it. Does not modify the reader, so several threads may parse
+   * different parts of the file; pcapng section and interface blocks met on
+   * the way are skipped and must already have been seen by Next () or Scan ().
+   * If found is given it receives the offset of the record that was parsed.
+   */
+  bool ParseAt (size_t offset, Record &record, size_t &next, size_t *found = 0) const
+  {
+    if (found)
+      {
+        *found = offset;
+      }
+    if (m_ng)
+      {
+        uint32_t type;
+        while (BlockAt (offset, type, next))
+          {
+            if (IsPacketBlock (type) && PacketAt (offset, type, record))
+              {
+                if (found)
+                  {
+                    *found = offset;
+                  }
+                return true;
+              }
+            offset = next;
+          }
+        return false;
+      }
+    const size_t size = m_file.Size ();
+    if (offset + RECORD_HEADER_SIZE > size)
+      {
+        return false;
+      }
+    const uint8_t *p = m_file.Data () + offset;
+    uint32_t sec = Field (p);
+    uint32_t frac = Field (p + 4);
+    record.caplen = Field (p + 8);
+    record.len = Field (p + 12);
+    if (record.caplen > size - offset - RECORD_HEADER_SIZE)
+      {
+        return false;
+      }
+    const Interface &iface = m_interfaces[0];
+    record.tsNs = sec * 1000000000ull + frac * iface.nsPerUnit;
+    record.linkType = iface.linkType;
+    record.interface = 0;
+    record.data = p + RECORD_HEADER_SIZE;
+    next = offset + RECORD_HEADER_SIZE + record.caplen;
+    return true;
+  }
+
+  /**
+   * End of the record (pcapng: block) at offset without decoding it, or 0
+   * if it does not fit in the file. packet tells whether it holds a packet
+   * and meta whether it is a pcapng section header or interface block.
+   */
+  size_t RecordEnd (size_t offset, bool &packet, bool &meta) const
+  {
+    const size_t size = m_file.Size ();
+    if (m_ng)
+      {
+        uint32_t type;
+        size_t next;
+        if (!BlockAt (offset, type, next))
+          {
+            return 0;
+          }
+        packet = IsPacketBlock (type);
+        meta = type == BLOCK_SECTION_HEADER || type == BLOCK_INTERFACE;
+        return next;
+      }
+    if (offset + RECORD_HEADER_SIZE > size
+        || Field (m_file.Data () + offset + 8) > size - offset - RECORD_HEADER_SIZE)
+      {
+        return 0;
+      }
+    packet = true;
+    meta = false;
+    return offset + RECORD_HEADER_SIZE + Field (m_file.Data () + offset + 8);
+  }
+
+  /**
+   * Heuristic test that offset is a record (pcapng: block) boundary: the
+   * next few records must have plausible headers and chain exactly. Used
+   * to cut a capture into chunks without walking it from the start.
+   */
+  bool IsBoundary (size_t offset) const
+  {
+    const int CHAIN = 8;
+    const size_t size = m_file.Size ();
+    const uint32_t limit = std::max<uint32_t> (Snaplen (), 262144);
+    for (int i = 0; i < CHAIN && offset < size; ++i)
+      {
+        const uint8_t *p = m_file.Data () + offset;
+        if (m_ng)
+          {
+            uint32_t type;
+            size_t next;
+            if (offset % 4 != 0 || !BlockAt (offset, type, next) || next - offset > limit + 64
+                || Field (m_file.Data () + next - 4) != next - offset
+                || (type > 0x10 && type != BLOCK_SECTION_HEADER))
+              {
+                return false;
+              }
+            offset = next;
+            continue;
+          }
+        if (offset + RECORD_HEADER_SIZE > size)
+          {
+            return false;
+          }
+        uint32_t frac = Field (p + 4);
+        uint32_t caplen = Field (p + 8);
+        uint32_t len = Field (p + 12);
+        if (frac >= m_interfaces[0].unitsPerSec || caplen > len || caplen > limit || len > limit + 65536
+            || caplen > size - offset - RECORD_HEADER_SIZE)
+          {
+            return false;
+          }
+        offset += RECORD_HEADER_SIZE + caplen;
+      }
+    return true;
+  }
+
+  /**
+   * Walk the record boundaries from the current position without decoding
+   * packets, registering pcapng interfaces on the way, and call
+   * visit (offset) for every record. Leaves the reader at the end.
+   */
+  template <typename Visitor>
+  void Scan (Visitor visit)
+  {
+    Scan (visit, [] (size_t) {});
+  }
+
+  /// As Scan (visit), also calling meta (offset) for every pcapng section header and interface block
+  template <typename Visitor, typename MetaVisitor>
+  void Scan (Visitor visit, MetaVisitor meta)
+  {
+    const size_t size = m_file.Size ();
+    while (true)
+      {
+        if (!m_ng)
+          {
+            if (m_pos + RECORD_HEADER_SIZE > size)
+              {
+                return;
+              }
+            size_t next = m_pos + RECORD_HEADER_SIZE + Field (m_file.Data () + m_pos + 8);
+            if (next > size)
+              {
+                return;
+              }
+            visit (m_pos);
+            m_pos = next;
+            continue;
+          }
+        uint32_t type;
+        size_t next;
+        if (!BlockAt (m_pos, type, next))
+          {
+            return;
+          }
+        if (IsPacketBlock (type))
+          {
+            visit (m_pos);
+          }
+        else
+          {
+            if (type == BLOCK_SECTION_HEADER || type == BLOCK_INTERFACE)
+              {
+                meta (m_pos);
+              }
+            HandleBlock (m_pos, type);
+          }
+        m_pos = next;
+      }
+  }
+
+  /**
+   * Re-read the pcapng section header and interface blocks at the given
+   * offsets (as reported by Scan), so that ParseAt () can decode records
+   * that follow them without walking the file from the start.
+   */
+  void LoadBlocks (const uint64_t *offsets, size_t count)
+  {
+    for (size_t i = 0; i < count; ++i)
+      {
+        uint32_t type;
+        size_t next;
+        if (m_ng && BlockAt (offsets[i], type, next))
+          {
+            HandleBlock (offsets[i], type);
+          }
+      }
+  }
+
+  enum { HEADER_SIZE = 24, RECORD_HEADER_SIZE = 16 };
+
+  enum BlockType
+  {
+    BLOCK_INTERFACE = 1,
+    BLOCK_OBSOLETE_PACKET = 2,
+    BLOCK_SIMPLE_PACKET = 3,
+    BLOCK_ENHANCED_PACKET = 6,
+    BLOCK_SECTION_HEADER = 0x0a0d0d0a
+  };
+
+private:
+  uint32_t Field (const uint8_t *p) const
+  {
+    uint32_t v;
+    std::memcpy (&v, p, 4);
+    return m_swap ? __builtin_bswap32 (v) : v;
+  }
+  uint16_t Field16 (const uint8_t *p) const
+  {
+    uint16_t v;
+    std::memcpy (&v, p, 2);
+    return m_swap ? __builtin_bswap16 (v) : v;
+  }
+
+  static bool IsPacketBlock (uint32_t type)
+  {
+    return type == BLOCK_ENHANCED_PACKET || type == BLOCK_SIMPLE_PACKET || type == BLOCK_OBSOLETE_PACKET;
+  }
+
+  /// Type and end of the pcapng block at offset; false if it does not fit in the file
+  bool BlockAt (size_t offset, uint32_t &type, size_t &next) const
+  {
+    const size_t size = m_file.Size ();
+    if (offset + 12 > size)
+      {
+        return false;
+      }
+    const uint8_t *p = m_file.Data () + offset;
+    std::memcpy (&type, p, 4);  // the section header type is a palindrome
+    uint32_t length;
+    if (type == BLOCK_SECTION_HEADER)
+      {
+        uint32_t order;
+        std::memcpy (&order, p + 8, 4);
+        std::memcpy (&length, p + 4, 4);
+        if (order == 0x4d3c2b1a)
+          {
+            length = __builtin_bswap32 (length);
+          }
+      }
+    else
+      {
+        type = Field (p);
+        length = Field (p + 4);
+      }
+    if (length < 12 || length % 4 != 0 || length > size - offset)
+      {
+        return false;
+      }
+    next = offset + length;
+    return true;
+  }
+
+  /// Fill record from the packet block at offset
+  bool PacketAt (size_t offset, uint32_t type, Record &record) const
+  {
+    const uint8_t *p = m_file.Data () + offset;
+    uint32_t length = Field (p + 4);
+    uint32_t interface = 0;
+    uint64_t ts = 0;
+    const uint8_t *data;
+    if (type == BLOCK_SIMPLE_PACKET)
+      {
+        if (length < 16)
+          {
+            return false;
+          }
+        record.len = Field (p + 8);
+        record.caplen = std::min (record.len, length - 16);
+        data = p + 12;
+      }
+    else
+      {
+        if (length < 32)
+          {
+            return false;
+          }
+        interface = type == BLOCK_ENHANCED_PACKET ? Field (p + 8) : Field16 (p + 8);
+        ts = (static_cast<uint64_t> (Field (p + 12)) << 32) | Field (p + 16);
+        record.caplen = Field (p + 20);
+        record.len = Field (p + 24);
+        data = p + 28;
+        if (record.caplen > length - 32)
+          {
+            return false;
+          }
+      }
+    if (interface >= m_interfaces.size ())
+      {
+        return false;
+      }
+    const Interface &iface = m_interfaces[interface];
+    record.tsNs = iface.ToNs (ts);
+    record.linkType = iface.linkType;
+    record.interface = interface;
+    record.data = data;
+    return true;
+  }
+
+  /// Section header: byte order and a fresh interface table. Interface description: add it.
+  void HandleBlock (size_t offset, uint32_t type)
+  {
+    const uint8_t *p = m_file.Data () + offset;
+    if (type == BLOCK_SECTION_HEADER)
+      {
+        uint32_t order;
+        std::memcpy (&order, p + 8, 4);
+        m_swap = order == 0x4d3c2b1a;
+        m_interfaces.clear ();
+        return;
+      }
+    if (type != BLOCK_INTERFACE)
+      {
+        return;
+      }
+    uint32_t length = Field (p + 4);
+    Interface iface;
+    iface.linkType = Field16 (p + 8);
+    iface.snaplen = length >= 20 ? Field (p + 12) : 0;
+    iface.unitsPerSec = 1000000;
+    iface.offsetSec = 0;
+    // Options: if_tsresol (9) and if_tsoffset (14)
+    const uint8_t *opt = p + 16;
+    const uint8_t *end = p + length - 4;
+    while (opt + 4 <= end)
+      {
+        uint16_t code = Field16 (opt);
+        uint16_t len = Field16 (opt + 2);
+        if (code == 0 || opt + 4 + len > end)
+          {
+            break;
+          }
+        if (code == 9 && len >= 1)
+          {
+            uint8_t resol = opt[4];
+            // 10^19 and 2^63 are the finest resolutions a 64-bit tick count can express
+            if ((resol & 0x7f) > ((resol & 0x80) ? 63 : 19))
+              {
+                throw std::runtime_error ("pcapng interface with unsupported if_tsresol");
+              }
+            uint64_t units = 1;
+            for (int i = 0; i < (resol & 0x7f); ++i)
+              {
+                units *= (resol & 0x80) ? 2 : 10;
+              }
+            iface.unitsPerSec = units;
+          }
+        else if (code == 14 && len >= 8)
+          {
+            uint64_t off;
+            std::memcpy (&off, opt + 4, 8);
+            iface.offsetSec = static_cast<int64_t> (m_swap ? __builtin_bswap64 (off) : off);
+          }
+        opt += 4 + ((len + 3) & ~3);
+      }
+    iface.nsPerUnit = iface.unitsPerSec <= 1000000000ull && 1000000000ull % iface.unitsPerSec == 0
+                      ? 1000000000ull / iface.unitsPerSec : 0;
+    m_interfaces.push_back (iface);
+  }
+
+  MappedFile m_file;
+  size_t m_pos;
+  bool m_ng;
+  bool m_swap;
+  std::vector<Interface> m_interfaces;
+};
+
+/// Decoded view of an IPv4 packet; pointers refer into the capture
+struct Packet
+{
+  const uint8_t *ip;       //!< start of the IPv4 header, 0 if not IPv4
+  const uint8_t *l4;       //!< start of the TCP/UDP header
+  const uint8_t *payload;  //!< start of the transport payload
+  uint32_t src;            //!< IPv4 addresses in host byte order
+  uint32_t dst;
+  uint16_t ipLen;          //!< total length from the IPv4 header
+  uint16_t ipHeaderLen;
+  uint8_t proto;           //!< IPPROTO_TCP (6), IPPROTO_UDP (17), ...
+  uint8_t ttl;
+  bool fragment;           //!< non-first fragment, no transport header
+  uint16_t sport;
+  uint16_t dport;
+  uint32_t payloadLen;     //!< transport payload bytes according to the headers
+  // TCP only
+  uint32_t seq;
+  uint32_t ack;
+  uint16_t window;
+  uint8_t tcpFlags;
+  uint8_t tcpHeaderLen;
+};
+
+enum TcpFlags
+{
+  TCP_FIN = 0x01,
+  TCP_SYN = 0x02,
+  TCP_RST = 0x04,
+  TCP_PSH = 0x08,
+  TCP_ACK = 0x10,
+  TCP_URG = 0x20
+};
+
+/**
+ * Decode the IPv4 header and the TCP/UDP header of a frame in place.
+ * Returns false when the frame is not IPv4 or is truncated before the
+ * IPv4 header; transport fields are zero when they are not present.
+ */
+inline bool
+Decode (uint32_t linkType, const uint8_t *data, uint32_t caplen, Packet &pkt)
+{
+  std::memset (&pkt, 0, sizeof (pkt));
+  const uint8_t *end = data + caplen;
+  const uint8_t *p = data;
+  uint16_t etherType;
+  switch (linkType)
+    {
+    case LINKTYPE_ETHERNET:
+      if (caplen < 14)
+        {
+          return false;
+        }
+      etherType = Load16 (p + 12);
+      p += 14;
+      while ((etherType == 0x8100 || etherType == 0x88a8) && p + 4 <= end)
+        {
+          etherType = Load16 (p + 2);
+          p += 4;
+        }
+      break;
+    case LINKTYPE_LINUX_SLL:
+      if (caplen < 16)
+        {
+          return false;
+        }
+      etherType = Load16 (p + 14);
+      p += 16;
+      break;
+    case LINKTYPE_RAW:
+      etherType = 0x0800;
+      break;
+    default:
+      return false;
+    }
+  if (etherType != 0x0800 || p + 20 > end || (p[0] >> 4) != 4)
+    {
+      return false;
+    }
+
+  pkt.ip = p;
+  pkt.ipHeaderLen = (p[0] & 0x0f) * 4;
+  pkt.ipLen = Load16 (p + 2);
+  pkt.fragment = (Load16 (p + 6) & 0x1fff) != 0;
+  pkt.ttl = p[8];
+  pkt.proto = p[9];
+  pkt.src = Load32 (p + 12);
+  pkt.dst = Load32 (p + 16);
+  if (pkt.ipHeaderLen < 20 || pkt.fragment)
+    {
+      return true;
+    }
+
+  const uint8_t *l4 = p + pkt.ipHeaderLen;
+  // TSO captures carry ip total length 0, fall back to what was captured
+  uint32_t ipEnd = pkt.ipLen >= pkt.ipHeaderLen ? pkt.ipLen : static_cast<uint32_t> (end - p);
+  if (pkt.proto == 6 && l4 + 20 <= end)
+    {
+      pkt.l4 = l4;
+      pkt.sport = Load16 (l4);
+      pkt.dport = Load16 (l4 + 2);
+      pkt.seq = Load32 (l4 + 4);
+      pkt.ack = Load32 (l4 + 8);
+      pkt.tcpHeaderLen = (l4[12] >> 4) * 4;
+      pkt.tcpFlags = l4[13];
+      pkt.window = Load16 (l4 + 14);
+      pkt.payload = l4 + pkt.tcpHeaderLen;
+      uint32_t headers = pkt.ipHeaderLen + pkt.tcpHeaderLen;
+      pkt.payloadLen = ipEnd > headers ? ipEnd - headers : 0;
+    }
+  else if (pkt.proto == 17 && l4 + 8 <= end)
+    {
+      pkt.l4 = l4;
+      pkt.sport = Load16 (l4);
+      pkt.dport = Load16 (l4 + 2);
+      pkt.payload = l4 + 8;
+      uint16_t udpLen = Load16 (l4 + 4);
+      pkt.payloadLen = udpLen > 8 ? udpLen - 8 : 0;
+    }
+  return true;
+}
+
+/// Dotted-quad form of a host-order IPv4 address
+inline std::string
+FormatIpv4 (uint32_t addr)
+{
+  char buf[16];
+  snprintf (buf, sizeof (buf), "%u.%u.%u.%u", addr >> 24, (addr >> 16) & 0xff, (addr >> 8) & 0xff,
+            addr & 0xff);
+  return buf;
+}
+
+} // namespace pcap
+
+#endif /* PCAP_READER_H */
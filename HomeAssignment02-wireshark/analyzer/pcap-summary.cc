@@ -0,0 +1,130 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * One-pass summary of pcap/pcapng captures: record and byte counts per
+ * protocol, capture duration and how fast the file was walked.
+ *
+ * Build: g++ -O2 -std=c++11 -o pcap-summary pcap-summary.cc
+ * Usage: ./pcap-summary [-Y filter] "../Task 1/trace0.pcap" [more.pcap ...]
+ *   -Y  only count matching packets (see packet-filter.h), e.g. -Y "tcp.port == 22"
+ */
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <getopt.h>
+#include "packet-filter.h"
+
+namespace {
+
+struct Counter
+{
+  uint64_t packets = 0;
+  uint64_t bytes = 0;
+
+  void Add (uint32_t len)
+  {
+    packets++;
+    bytes += len;
+  }
+};
+
+void
+Summarize (const std::string &path, const pcap::PacketFilter &filter)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+  pcap::PcapReader reader (path);
+  Counter total, ipv4, tcp, udp, other;
+  uint64_t first = 0, last = 0;
+  pcap::Record rec;
+  pcap::Packet pkt;
+  while (reader.Next (rec))
+    {
+      bool ip = pcap::Decode (rec.linkType, rec.data, rec.caplen, pkt);
+      if (!filter.Matches (rec, pkt, ip))
+        {
+          continue;
+        }
+      if (total.packets == 0)
+        {
+          first = rec.tsNs;
+        }
+      last = rec.tsNs;
+      total.Add (rec.len);
+      if (!ip)
+        {
+          other.Add (rec.len);
+          continue;
+        }
+      ipv4.Add (rec.len);
+      if (pkt.proto == 6)
+        {
+          tcp.Add (rec.len);
+        }
+      else if (pkt.proto == 17)
+        {
+          udp.Add (rec.len);
+        }
+    }
+  double elapsed = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+
+  std::cout << path << "\n";
+  std::cout << "  Format:     " << (reader.IsPcapng () ? "pcapng" : "pcap") << ", "
+            << reader.Interfaces ().size () << " interface(s), link type " << reader.LinkType () << "\n";
+  std::cout << "  Duration:   " << (last - first) / 1e9 << " s\n";
+  std::cout << "  Packets:    " << total.packets << " (" << total.bytes << " bytes)\n";
+  std::cout << "  IPv4:       " << ipv4.packets << " (" << ipv4.bytes << " bytes)\n";
+  std::cout << "  TCP:        " << tcp.packets << " (" << tcp.bytes << " bytes)\n";
+  std::cout << "  UDP:        " << udp.packets << " (" << udp.bytes << " bytes)\n";
+  std::cout << "  Non-IPv4:   " << other.packets << " (" << other.bytes << " bytes)\n";
+  std::cout << "  Scan rate:  " << std::fixed << std::setprecision (1)
+            << reader.File ().Size () / elapsed / 1e6 << " MB/s\n" << std::defaultfloat << std::setprecision (6);
+}
+
+} // namespace
+
+int
+main (int argc, char **argv)
+{
+  std::string expression;
+  int opt;
+  while ((opt = getopt (argc, argv, "Y:")) != -1)
+    {
+      switch (opt)
+        {
+        case 'Y': expression = optarg; break;
+        default:
+          std::cerr << "usage: " << argv[0] << " [-Y filter] capture.pcap [...]\n";
+          return 1;
+        }
+    }
+  if (optind >= argc)
+    {
+      std::cerr << "usage: " << argv[0] << " [-Y filter] capture.pcap [...]\n";
+      return 1;
+    }
+  pcap::PacketFilter filter;
+  try
+    {
+      filter = pcap::PacketFilter (expression);
+    }
+  catch (const std::exception &e)
+    {
+      std::cerr << "error: " << e.what () << "\n";
+      return 1;
+    }
+
+  int status = 0;
+  for (int i = optind; i < argc; ++i)
+    {
+      try
+        {
+          Summarize (argv[i], filter);
+        }
+      catch (const std::exception &e)
+        {
+          std::cerr << "error: " << e.what () << "\n";
+          status = 1;
+        }
+    }
+  return status;
+}
@@ -0,0 +1,551 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * One-pass per-connection TCP analysis: RTT distribution from matching
+ * data segments to the ACKs that cover them (Karn's rule: retransmitted
+ * ranges give no samples), goodput and bytes in flight per interval.
+ *
+ * Connections live in a fixed-capacity open-addressing table. When it
+ * fills up, closed and idle connections are reported and dropped, then the
+ * least recently active ones, so memory stays bounded on long captures.
+ *
+ * Build: g++ -O2 -std=c++11 -o tcp-analyzer tcp-analyzer.cc
+ * Usage: ./tcp-analyzer [-i interval_s] [-t timeseries.csv] [-c capacity]
+ *                       [-I idle_s] capture.pcap
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include <getopt.h>
+#include "pcap-reader.h"
+
+namespace {
+
+/// Serial number arithmetic on 32-bit sequence numbers
+inline bool
+SeqLt (uint32_t a, uint32_t b)
+{
+  return static_cast<int32_t> (a - b) < 0;
+}
+
+inline bool
+SeqGt (uint32_t a, uint32_t b)
+{
+  return static_cast<int32_t> (a - b) > 0;
+}
+
+/// Fixed-size log-bucketed histogram of RTTs in microseconds, 4 buckets per octave
+class RttHistogram
+{
+public:
+  RttHistogram ()
+    : m_count (0),
+      m_sum (0),
+      m_min (~0ull),
+      m_max (0)
+  {
+    std::fill (m_buckets, m_buckets + BUCKETS, 0);
+  }
+
+  void Add (uint64_t us)
+  {
+    m_buckets[Index (us)]++;
+    m_count++;
+    m_sum += us;
+    m_min = std::min (m_min, us);
+    m_max = std::max (m_max, us);
+  }
+
+  uint64_t Count () const
+  {
+    return m_count;
+  }
+  double MeanMs () const
+  {
+    return m_count ? m_sum / 1e3 / m_count : 0;
+  }
+  double MinMs () const
+  {
+    return m_count ? m_min / 1e3 : 0;
+  }
+  double MaxMs () const
+  {
+    return m_max / 1e3;
+  }
+
+  /// Upper edge of the bucket holding quantile q, in milliseconds
+  double PercentileMs (double q) const
+  {
+    uint64_t rank = static_cast<uint64_t> (std::ceil (q * m_count));
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; ++i)
+      {
+        seen += m_buckets[i];
+        if (seen >= rank && seen > 0)
+          {
+            return std::min (static_cast<double> (m_max), UpperEdge (i)) / 1e3;
+          }
+      }
+    return MaxMs ();
+  }
+
+private:
+  enum { BUCKETS = 4 * 40 };
+
+  static int Index (uint64_t us)
+  {
+    if (us < 4)
+      {
+        return static_cast<int> (us);
+      }
+    int octave = 63 - __builtin_clzll (us);
+    int sub = static_cast<int> ((us >> (octave - 2)) & 3);
+    return std::min (4 * (octave - 1) + sub, BUCKETS - 1);
+  }
+  static double UpperEdge (int index)
+  {
+    if (index < 4)
+      {
+        return index;
+      }
+    int octave = index / 4 + 1;
+    int sub = index % 4;
+    return std::ldexp (4 + sub + 1, octave - 2);
+  }
+
+  uint32_t m_buckets[BUCKETS];
+  uint64_t m_count;
+  uint64_t m_sum;
+  uint64_t m_min;
+  uint64_t m_max;
+};
+
+/// Sender side of one direction of a connection
+struct Direction
+{
+  enum { RING = 64 };
+
+  bool init = false;
+  uint32_t sndNxt = 0;          //!< highest sequence number sent + 1
+  uint32_t sndUna = 0;          //!< highest cumulative ACK from the peer
+  uint64_t packets = 0;
+  uint64_t payloadBytes = 0;    //!< including retransmissions
+  uint64_t ackedBytes = 0;      //!< new data acknowledged by the peer
+  bool syn = false;             //!< a SYN was sent, at synSeq
+  uint32_t synSeq = 0;
+  bool fin = false;             //!< a FIN was sent, at finSeq
+  uint32_t finSeq = 0;
+  uint64_t retransmits = 0;
+  uint32_t maxInFlight = 0;
+  // Outstanding segments eligible for an RTT sample: end sequence and send time
+  uint32_t ringSeq[RING];
+  uint64_t ringTs[RING];
+  uint32_t ringHead = 0;
+  uint32_t ringCount = 0;
+  RttHistogram rtt;
+  // Current interval
+  uint64_t intervalAcked = 0;
+  uint64_t intervalFlightSum = 0;
+  uint32_t intervalFlightSamples = 0;
+  uint32_t intervalFlightMax = 0;
+  uint32_t intervalRttSamples = 0;
+  uint64_t intervalRttSum = 0;
+};
+
+struct Connection
+{
+  bool used = false;
+  uint32_t addr[2];             //!< endpoint 0 is the lower (address, port)
+  uint16_t port[2];
+  uint32_t id = 0;
+  uint64_t first = 0;
+  uint64_t last = 0;
+  uint64_t intervalStart = 0;
+  bool fin[2] = { false, false };
+  bool rst = false;
+  Direction dir[2];             //!< dir[i]: data sent by endpoint i
+};
+
+class TcpAnalyzer
+{
+public:
+  TcpAnalyzer (size_t capacity, double interval, double idle, std::ostream *series)
+    : m_table (RoundUp (capacity * 4 / 3 + 1)),
+      m_capacity (capacity),
+      m_used (0),
+      m_nextId (1),
+      m_interval (static_cast<uint64_t> (interval * 1e9)),
+      m_idle (static_cast<uint64_t> (idle * 1e9)),
+      m_series (series)
+  {
+    if (m_series)
+      {
+        *m_series << "conn,dir,time,goodputMbps,avgInFlight,maxInFlight,rttSamples,meanRttMs\n";
+      }
+  }
+
+  void Process (const pcap::Record &rec, const pcap::Packet &pkt)
+  {
+    bool reversed = pkt.src > pkt.dst || (pkt.src == pkt.dst && pkt.sport > pkt.dport);
+    Connection &c = Find (pkt, reversed, rec.tsNs);
+    int s = reversed ? 1 : 0;  // sending endpoint
+    Direction &snd = c.dir[s];
+    Direction &peer = c.dir[1 - s];
+    AdvanceInterval (c, rec.tsNs);
+    c.last = rec.tsNs;
+
+    // Data (and SYN/FIN, which occupy one sequence number each)
+    uint32_t len = pkt.payloadLen + ((pkt.tcpFlags & pcap::TCP_SYN) ? 1 : 0)
+      + ((pkt.tcpFlags & pcap::TCP_FIN) ? 1 : 0);
+    snd.packets++;
+    snd.payloadBytes += pkt.payloadLen;
+    if (len > 0)
+      {
+        uint32_t end = pkt.seq + len;
+        if (!snd.init)
+          {
+            snd.init = true;
+            snd.sndUna = pkt.seq;
+            snd.sndNxt = pkt.seq;
+          }
+        if (pkt.tcpFlags & pcap::TCP_SYN)
+          {
+            snd.syn = true;
+            snd.synSeq = pkt.seq;
+          }
+        if (pkt.tcpFlags & pcap::TCP_FIN)
+          {
+            snd.fin = true;
+            snd.finSeq = end - 1;
+          }
+        if (SeqGt (end, snd.sndNxt))
+          {
+            if (SeqLt (pkt.seq, snd.sndNxt))
+              {
+                snd.retransmits++;  // partly old data: ambiguous, no sample
+              }
+            else
+              {
+                Push (snd, end, rec.tsNs);
+              }
+            snd.sndNxt = end;
+          }
+        else
+          {
+            // Retransmission: any outstanding sample beyond seq is now ambiguous
+            snd.retransmits++;
+            while (snd.ringCount > 0 && SeqGt (snd.ringSeq[Slot (snd, snd.ringCount - 1)], pkt.seq))
+              {
+                snd.ringCount--;
+              }
+          }
+        uint32_t flight = snd.sndNxt - snd.sndUna;
+        snd.maxInFlight = std::max (snd.maxInFlight, flight);
+        snd.intervalFlightSum += flight;
+        snd.intervalFlightSamples++;
+        snd.intervalFlightMax = std::max (snd.intervalFlightMax, flight);
+      }
+
+    // Acknowledgement of the peer's data
+    if ((pkt.tcpFlags & pcap::TCP_ACK) && peer.init && SeqGt (pkt.ack, peer.sndUna)
+        && !SeqGt (pkt.ack, peer.sndNxt))
+      {
+        // SYN and FIN take a sequence number each but carry no data
+        uint32_t acked = pkt.ack - peer.sndUna;
+        if (peer.syn && !SeqLt (peer.synSeq, peer.sndUna) && SeqLt (peer.synSeq, pkt.ack))
+          {
+            acked--;
+          }
+        if (peer.fin && !SeqLt (peer.finSeq, peer.sndUna) && SeqLt (peer.finSeq, pkt.ack))
+          {
+            acked--;
+          }
+        peer.sndUna = pkt.ack;
+        peer.ackedBytes += acked;
+        peer.intervalAcked += acked;
+        bool sampled = false;
+        uint64_t sentAt = 0;
+        while (peer.ringCount > 0 && !SeqGt (peer.ringSeq[peer.ringHead], pkt.ack))
+          {
+            sentAt = peer.ringTs[peer.ringHead];
+            sampled = true;
+            peer.ringHead = (peer.ringHead + 1) % Direction::RING;
+            peer.ringCount--;
+          }
+        if (sampled)
+          {
+            uint64_t us = (rec.tsNs - sentAt) / 1000;
+            peer.rtt.Add (us);
+            peer.intervalRttSamples++;
+            peer.intervalRttSum += us;
+          }
+      }
+
+    if (pkt.tcpFlags & pcap::TCP_FIN)
+      {
+        c.fin[s] = true;
+      }
+    if (pkt.tcpFlags & pcap::TCP_RST)
+      {
+        c.rst = true;
+      }
+  }
+
+  /// Report every connection still in the table
+  void Finish ()
+  {
+    for (size_t i = 0; i < m_table.size (); ++i)
+      {
+        if (m_table[i].used)
+          {
+            Report (m_table[i]);
+          }
+      }
+  }
+
+private:
+  static size_t RoundUp (size_t n)
+  {
+    size_t size = 16;
+    while (size < n)
+      {
+        size <<= 1;
+      }
+    return size;
+  }
+
+  static uint32_t Slot (const Direction &d, uint32_t i)
+  {
+    return (d.ringHead + i) % Direction::RING;
+  }
+
+  static void Push (Direction &d, uint32_t end, uint64_t ts)
+  {
+    if (d.ringCount == Direction::RING)
+      {
+        d.ringHead = (d.ringHead + 1) % Direction::RING;  // forget the oldest
+        d.ringCount--;
+      }
+    uint32_t slot = Slot (d, d.ringCount);
+    d.ringSeq[slot] = end;
+    d.ringTs[slot] = ts;
+    d.ringCount++;
+  }
+
+  size_t Hash (uint32_t a0, uint16_t p0, uint32_t a1, uint16_t p1) const
+  {
+    uint64_t h = (static_cast<uint64_t> (a0) << 32 | a1) * 0x9e3779b97f4a7c15ull;
+    h ^= (static_cast<uint64_t> (p0) << 16 | p1) * 0xc2b2ae3d27d4eb4full;
+    h ^= h >> 29;
+    return static_cast<size_t> (h) & (m_table.size () - 1);
+  }
+
+  Connection &Find (const pcap::Packet &pkt, bool reversed, uint64_t now)
+  {
+    uint32_t a0 = reversed ? pkt.dst : pkt.src, a1 = reversed ? pkt.src : pkt.dst;
+    uint16_t p0 = reversed ? pkt.dport : pkt.sport, p1 = reversed ? pkt.sport : pkt.dport;
+    size_t mask = m_table.size () - 1;
+    size_t i = Hash (a0, p0, a1, p1);
+    while (m_table[i].used)
+      {
+        Connection &c = m_table[i];
+        if (c.addr[0] == a0 && c.addr[1] == a1 && c.port[0] == p0 && c.port[1] == p1)
+          {
+            return c;
+          }
+        i = (i + 1) & mask;
+      }
+    if (m_used >= m_capacity)
+      {
+        Evict (now);
+        return Find (pkt, reversed, now);
+      }
+    Connection &c = m_table[i];
+    c = Connection ();
+    c.used = true;
+    c.addr[0] = a0;
+    c.addr[1] = a1;
+    c.port[0] = p0;
+    c.port[1] = p1;
+    c.id = m_nextId++;
+    c.first = c.last = c.intervalStart = now;
+    m_used++;
+    return c;
+  }
+
+  /// Report and drop closed and idle connections, then the least recently active, and rehash
+  void Evict (uint64_t now)
+  {
+    std::vector<Connection> live;
+    live.reserve (m_used);
+    for (size_t i = 0; i < m_table.size (); ++i)
+      {
+        Connection &c = m_table[i];
+        if (!c.used)
+          {
+            continue;
+          }
+        if (c.rst || (c.fin[0] && c.fin[1]) || (now > c.last && now - c.last > m_idle))
+          {
+            Report (c);
+          }
+        else
+          {
+            live.push_back (c);
+          }
+        c.used = false;
+      }
+    if (live.size () > m_capacity / 2)
+      {
+        std::sort (live.begin (), live.end (),
+                   [] (const Connection &x, const Connection &y) { return x.last > y.last; });
+        for (size_t i = m_capacity / 2; i < live.size (); ++i)
+          {
+            Report (live[i]);
+          }
+        live.resize (m_capacity / 2);
+      }
+    size_t mask = m_table.size () - 1;
+    for (size_t k = 0; k < live.size (); ++k)
+      {
+        size_t i = Hash (live[k].addr[0], live[k].port[0], live[k].addr[1], live[k].port[1]);
+        while (m_table[i].used)
+          {
+            i = (i + 1) & mask;
+          }
+        m_table[i] = live[k];
+      }
+    m_used = live.size ();
+  }
+
+  void AdvanceInterval (Connection &c, uint64_t now)
+  {
+    if (now < c.intervalStart + m_interval)
+      {
+        return;
+      }
+    EmitInterval (c);
+    c.intervalStart += (now - c.intervalStart) / m_interval * m_interval;
+  }
+
+  void EmitInterval (Connection &c)
+  {
+    for (int d = 0; d < 2; ++d)
+      {
+        Direction &dir = c.dir[d];
+        if (m_series && (dir.intervalAcked || dir.intervalFlightSamples))
+          {
+            *m_series << c.id << ',' << d << ',' << (c.intervalStart - c.first) / 1e9 << ','
+                      << dir.intervalAcked * 8.0 / (m_interval / 1e9) / 1e6 << ','
+                      << (dir.intervalFlightSamples ? dir.intervalFlightSum / dir.intervalFlightSamples : 0) << ','
+                      << dir.intervalFlightMax << ',' << dir.intervalRttSamples << ','
+                      << (dir.intervalRttSamples ? dir.intervalRttSum / 1e3 / dir.intervalRttSamples : 0) << '\n';
+          }
+        dir.intervalAcked = 0;
+        dir.intervalFlightSum = 0;
+        dir.intervalFlightSamples = 0;
+        dir.intervalFlightMax = 0;
+        dir.intervalRttSamples = 0;
+        dir.intervalRttSum = 0;
+      }
+  }
+
+  void Report (Connection &c)
+  {
+    EmitInterval (c);
+    double duration = (c.last - c.first) / 1e9;
+    std::cout << "Connection " << c.id << ": " << pcap::FormatIpv4 (c.addr[0]) << ":" << c.port[0]
+              << " <-> " << pcap::FormatIpv4 (c.addr[1]) << ":" << c.port[1] << ", " << duration << " s"
+              << (c.rst ? ", reset" : (c.fin[0] && c.fin[1]) ? ", closed" : "") << "\n";
+    for (int d = 0; d < 2; ++d)
+      {
+        const Direction &dir = c.dir[d];
+        if (dir.payloadBytes == 0)
+          {
+            continue;
+          }
+        std::cout << "  " << (d ? "B->A" : "A->B") << ": " << dir.packets << " packets, "
+                  << dir.payloadBytes << " payload bytes, " << dir.retransmits << " retransmits\n";
+        std::cout << "    Goodput:        " << (duration > 0 ? dir.ackedBytes * 8.0 / duration / 1e6 : 0)
+                  << " Mbps (" << dir.ackedBytes << " bytes acked)\n";
+        std::cout << "    Max in flight:  " << dir.maxInFlight << " bytes\n";
+        if (dir.rtt.Count ())
+          {
+            std::cout << "    RTT (ms):       " << dir.rtt.Count () << " samples, min " << dir.rtt.MinMs ()
+                      << ", mean " << dir.rtt.MeanMs () << ", p50 " << dir.rtt.PercentileMs (0.5)
+                      << ", p90 " << dir.rtt.PercentileMs (0.9) << ", p99 " << dir.rtt.PercentileMs (0.99)
+                      << ", max " << dir.rtt.MaxMs () << "\n";
+          }
+      }
+  }
+
+  std::vector<Connection> m_table;
+  size_t m_capacity;
+  size_t m_used;
+  uint32_t m_nextId;
+  uint64_t m_interval;
+  uint64_t m_idle;
+  std::ostream *m_series;
+};
+
+} // namespace
+
+int
+main (int argc, char **argv)
+{
+  double interval = 1.0;
+  double idle = 120.0;
+  size_t capacity = 65536;
+  std::string seriesFile;
+  int opt;
+  while ((opt = getopt (argc, argv, "i:t:c:I:")) != -1)
+    {
+      switch (opt)
+        {
+        case 'i': interval = std::atof (optarg); break;
+        case 't': seriesFile = optarg; break;
+        case 'c': capacity = std::strtoul (optarg, 0, 10); break;
+        case 'I': idle = std::atof (optarg); break;
+        default:
+          std::cerr << "usage: " << argv[0]
+                    << " [-i interval_s] [-t timeseries.csv] [-c capacity] [-I idle_s] capture.pcap\n";
+          return 1;
+        }
+    }
+  if (optind != argc - 1 || interval <= 0 || capacity < 2)
+    {
+      std::cerr << "usage: " << argv[0]
+                << " [-i interval_s] [-t timeseries.csv] [-c capacity] [-I idle_s] capture.pcap\n";
+      return 1;
+    }
+
+  try
+    {
+      pcap::PcapReader reader (argv[optind]);
+      std::ofstream series;
+      if (!seriesFile.empty ())
+        {
+          series.open (seriesFile.c_str ());
+        }
+      TcpAnalyzer analyzer (capacity, interval, idle, seriesFile.empty () ? 0 : &series);
+      pcap::Record rec;
+      pcap::Packet pkt;
+      while (reader.Next (rec))
+        {
+          if (pcap::Decode (rec.linkType, rec.data, rec.caplen, pkt) && pkt.proto == 6 && pkt.l4)
+            {
+              analyzer.Process (rec, pkt);
+            }
+        }
+      analyzer.Finish ();
+    }
+  catch (const std::exception &e)
+    {
+      std::cerr << "error: " << e.what () << "\n";
+      return 1;
+    }
+  return 0;
+}
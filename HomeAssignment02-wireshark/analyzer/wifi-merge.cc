@@ -0,0 +1,545 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Channel view of an ns-3 802.11 run: merges the per-node captures
+ * (basic-pcap-node-*.pcap, rtscts-pcap-node-*.pcap, link type 105) by
+ * timestamp and reports channel airtime, RTS/CTS overhead and overlapping
+ * transmissions, optionally writing the merged capture.
+ *
+ * All captures are memory-mapped and merged through a heap holding the
+ * next record of every file, so records are never copied. ns-3 stamps a
+ * frame in the sender's capture when its transmission starts and in every
+ * receiver's capture when the reception ends, so one transmission shows up
+ * as byte-identical copies at most airtime + propagation delay apart
+ * (retransmissions differ in the Retry bit or come at least an ACK timeout
+ * later). Copies within airtime + slack of the first one are merged into
+ * one transmission; it started at the first copy when that is the
+ * sender's, otherwise one airtime earlier. A lone copy is the sender's
+ * when its transmitter address is the capture's own, as learnt from
+ * earlier transmissions. Transmissions are put back in start order
+ * through a small reorder heap before the overlap analysis.
+ *
+ * DLT 105 records carry no rate, so airtime assumes 802.11a OFDM as in
+ * the Lab 02 scripts: data at -d Mbps, RTS, CTS and broadcast at the
+ * control rate -c and ACKs at -a, with the FCS included in the frame.
+ *
+ * Build: g++ -O2 -std=c++11 -o wifi-merge wifi-merge.cc
+ * Usage: ./wifi-merge [-d Mbps] [-c Mbps] [-a Mbps] [-s slack_us] [-n top] [-w merged.pcap] node.pcap [...]
+ *   defaults: -d 54 -c 6 -a 24 -s 10 -n 10
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <queue>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+#include <getopt.h>
+#include "pcap-reader.h"
+
+namespace {
+
+enum FrameType
+{
+  T_DATA,
+  T_MGMT,
+  T_RTS,
+  T_CTS,
+  T_ACK,
+  T_OTHER,
+  T_COUNT
+};
+
+const char *const TYPE_NAMES[T_COUNT] = { "DATA", "MGMT", "RTS", "CTS", "ACK", "other" };
+
+FrameType
+Classify (const uint8_t *frame, uint32_t caplen)
+{
+  if (caplen < 2)
+    {
+      return T_OTHER;
+    }
+  uint8_t type = (frame[0] >> 2) & 3;
+  uint8_t subtype = frame[0] >> 4;
+  switch (type)
+    {
+    case 0: return T_MGMT;
+    case 2: return T_DATA;
+    case 1: return subtype == 11 ? T_RTS : subtype == 12 ? T_CTS : subtype == 13 ? T_ACK : T_OTHER;
+    default: return T_OTHER;
+    }
+}
+
+uint64_t
+Mac (const uint8_t *p)
+{
+  uint64_t mac = 0;
+  for (int i = 0; i < 6; ++i)
+    {
+      mac = mac << 8 | p[i];
+    }
+  return mac;
+}
+
+/// Receiver address (addr1), 0 when the frame is too short
+uint64_t
+ReceiverOf (const uint8_t *frame, uint32_t caplen)
+{
+  return caplen >= 10 ? Mac (frame + 4) : 0;
+}
+
+/// Transmitter address (addr2), 0 for CTS and ACK which do not carry one
+uint64_t
+TransmitterOf (FrameType type, const uint8_t *frame, uint32_t caplen)
+{
+  return type != T_CTS && type != T_ACK && caplen >= 16 ? Mac (frame + 10) : 0;
+}
+
+std::string
+FormatMac (uint64_t mac)
+{
+  if (!mac)
+    {
+      return "?";
+    }
+  char buf[18];
+  snprintf (buf, sizeof (buf), "%02x:%02x:%02x:%02x:%02x:%02x", unsigned (mac >> 40) & 0xff,
+            unsigned (mac >> 32) & 0xff, unsigned (mac >> 24) & 0xff, unsigned (mac >> 16) & 0xff,
+            unsigned (mac >> 8) & 0xff, unsigned (mac) & 0xff);
+  return buf;
+}
+
+uint64_t
+HashFrame (const uint8_t *data, uint32_t len)
+{
+  uint64_t h = len * 0x9e3779b97f4a7c15ull;
+  while (len >= 8)
+    {
+      uint64_t w;
+      std::memcpy (&w, data, 8);
+      h = (h ^ w) * 0xff51afd7ed558ccdull;
+      h ^= h >> 32;
+      data += 8;
+      len -= 8;
+    }
+  while (len--)
+    {
+      h = (h ^ *data++) * 0xc4ceb9fe1a85ec53ull;
+    }
+  return h ^ (h >> 29);
+}
+
+/// 802.11a OFDM: preamble and SIGNAL, then 4 us symbols of SERVICE + PSDU + tail bits
+struct Airtime
+{
+  double dataMbps = 54;
+  double controlMbps = 6;
+  double ackMbps = 24;
+
+  static uint64_t Ofdm (uint32_t bytes, double mbps)
+  {
+    uint64_t bitsPerSymbol = static_cast<uint64_t> (4 * mbps);
+    uint64_t symbols = (16 + 8ull * bytes + 6 + bitsPerSymbol - 1) / bitsPerSymbol;
+    return 20000 + 4000 * symbols;
+  }
+
+  uint64_t Of (FrameType type, const uint8_t *frame, uint32_t len, uint32_t caplen) const
+  {
+    switch (type)
+      {
+      case T_RTS:
+      case T_CTS:
+        return Ofdm (len, controlMbps);
+      case T_ACK:
+        return Ofdm (len, ackMbps);
+      default:
+        // Broadcast and multicast go at the lowest rate, like ns-3's default non-unicast mode
+        return Ofdm (len, caplen >= 5 && (frame[4] & 1) ? controlMbps : dataMbps);
+      }
+  }
+};
+
+/// Copies of one frame seen so far
+struct Group
+{
+  uint64_t first;                        //!< time of the earliest copy
+  uint64_t last;
+  uint64_t airtime;
+  uint64_t hash;
+  uint32_t copies;
+  uint32_t file;                         //!< capture of the earliest copy
+  uint32_t caplen;
+  uint32_t len;
+  FrameType type;
+  const uint8_t *data;
+};
+
+struct Transmission
+{
+  uint64_t start;
+  uint64_t end;
+  uint64_t transmitter;                  //!< 0 when unknown
+  uint32_t caplen;
+  uint32_t len;
+  FrameType type;
+  const uint8_t *data;
+
+  bool operator> (const Transmission &o) const
+  {
+    return start > o.start;
+  }
+};
+
+class ChannelMerger
+{
+public:
+  ChannelMerger (const Airtime &airtime, uint64_t slackNs, size_t files, FILE *out)
+    : m_airtime (airtime),
+      m_slack (slackNs),
+      m_macs (files, 0),
+      m_out (out),
+      // Longest 802.11a PSDU at the lowest rate: how far back a start can be from a copy
+      m_horizon (2 * (Airtime::Ofdm (4095, std::min (airtime.controlMbps, airtime.dataMbps)) + slackNs))
+  {
+    if (m_out)
+      {
+        // Nanosecond pcap, 802.11
+        uint32_t header[6] = { 0xa1b23c4d, 0x00040002, 0, 0, 65535, pcap::LINKTYPE_IEEE802_11 };
+        std::fwrite (header, sizeof (header), 1, m_out);
+      }
+  }
+
+  /// Records must come in time order
+  void Add (uint32_t file, const pcap::Record &rec)
+  {
+    m_copies++;
+    Expire (rec.tsNs);
+    uint64_t hash = HashFrame (rec.data, rec.caplen);
+    auto it = m_index.find (hash);
+    if (it != m_index.end () && it->second >= m_base)
+      {
+        Group &g = m_open[it->second - m_base];
+        if (g.len == rec.len && g.caplen == rec.caplen && rec.tsNs <= g.first + g.airtime + m_slack
+            && std::memcmp (g.data, rec.data, rec.caplen) == 0)
+          {
+            g.last = rec.tsNs;
+            g.copies++;
+            return;
+          }
+      }
+    FrameType type = Classify (rec.data, rec.caplen);
+    Group g = { rec.tsNs, rec.tsNs, m_airtime.Of (type, rec.data, rec.len, rec.caplen), hash, 1, file,
+                rec.caplen, rec.len, type, rec.data };
+    m_index[hash] = m_base + m_open.size ();
+    m_open.push_back (g);
+  }
+
+  void Finish ()
+  {
+    Expire (~0ull);
+  }
+
+  void Report (std::ostream &os, size_t top) const
+  {
+    uint64_t span = m_lastEnd > m_firstStart ? m_lastEnd - m_firstStart : 0;
+    uint64_t total = 0;
+    for (int t = 0; t < T_COUNT; ++t)
+      {
+        total += m_typeAirtime[t];
+      }
+    os << m_copies << " records merged into " << m_transmissions << " transmissions\n";
+    os << std::fixed << std::setprecision (6) << "Channel: " << span / 1e9 << " s, busy " << m_busy / 1e9
+       << " s (" << std::setprecision (1) << Percent (m_busy, span) << "%)\n";
+    os << "  type   transmissions       airtime  share  overlapped\n";
+    for (int t = 0; t < T_COUNT; ++t)
+      {
+        if (!m_typeCount[t])
+          {
+            continue;
+          }
+        os << "  " << std::left << std::setw (6) << TYPE_NAMES[t] << std::right << std::setw (14)
+           << m_typeCount[t] << std::setw (12) << std::setprecision (6) << m_typeAirtime[t] / 1e9 << " s"
+           << std::setw (6) << std::setprecision (1) << Percent (m_typeAirtime[t], total) << "%"
+           << std::setw (12) << m_typeOverlapped[t] << "\n";
+      }
+    uint64_t rtscts = m_typeAirtime[T_RTS] + m_typeAirtime[T_CTS];
+    os << "RTS/CTS overhead: " << std::setprecision (6) << rtscts / 1e9 << " s, " << std::setprecision (1)
+       << Percent (rtscts, total) << "% of airtime, " << Percent (rtscts, m_typeAirtime[T_DATA])
+       << "% of data airtime\n";
+    os << "Overlapping transmissions: " << m_overlapped << " (" << Percent (m_overlapped, m_transmissions)
+       << "%), " << std::setprecision (6) << m_overlapTime / 1e9 << " s on air together\n";
+
+    std::vector<std::pair<uint64_t, std::pair<uint64_t, uint64_t> > > pairs;
+    for (auto it = m_pairs.begin (); it != m_pairs.end (); ++it)
+      {
+        pairs.push_back (std::make_pair (it->second, it->first));
+      }
+    std::sort (pairs.begin (), pairs.end (), std::greater<std::pair<uint64_t, std::pair<uint64_t, uint64_t> > > ());
+    for (size_t i = 0; i < pairs.size () && i < top; ++i)
+      {
+        os << "  " << FormatMac (pairs[i].second.first) << " and " << FormatMac (pairs[i].second.second) << ": "
+           << pairs[i].first << "\n";
+      }
+    os << std::defaultfloat << std::setprecision (6);
+  }
+
+private:
+  static double Percent (uint64_t part, uint64_t whole)
+  {
+    return whole ? 100.0 * part / whole : 0;
+  }
+
+  /// Close the groups no copy can join any more, then release the transmissions that are in order
+  void Expire (uint64_t now)
+  {
+    while (!m_open.empty () && (now == ~0ull || m_open.front ().first + m_open.front ().airtime + m_slack < now))
+      {
+        Close (m_open.front ());
+        auto it = m_index.find (m_open.front ().hash);
+        if (it != m_index.end () && it->second == m_base)
+          {
+            m_index.erase (it);
+          }
+        m_open.pop_front ();
+        m_base++;
+      }
+    while (!m_pending.empty () && (now == ~0ull || m_pending.top ().start + m_horizon < now))
+      {
+        Analyze (m_pending.top ());
+        m_pending.pop ();
+      }
+  }
+
+  bool IsOwn (uint32_t file, FrameType type, const uint8_t *data, uint32_t caplen) const
+  {
+    uint64_t mac = m_macs[file];
+    if (!mac)
+      {
+        return true;
+      }
+    uint64_t transmitter = TransmitterOf (type, data, caplen);
+    return transmitter ? transmitter == mac : ReceiverOf (data, caplen) != mac;
+  }
+
+  void Close (const Group &g)
+  {
+    uint64_t transmitter = TransmitterOf (g.type, g.data, g.caplen);
+    bool senderSeen;
+    if (g.last - g.first > m_slack)
+      {
+        // Receptions end an airtime after the start: the first copy is the sender's
+        senderSeen = true;
+        if (transmitter)
+          {
+            m_macs[g.file] = transmitter;
+          }
+      }
+    else
+      {
+        // Copies at the same time are receptions; a lone one may be either
+        senderSeen = g.copies == 1 && IsOwn (g.file, g.type, g.data, g.caplen);
+      }
+    if (!transmitter && senderSeen)
+      {
+        transmitter = m_macs[g.file];
+      }
+    uint64_t start = senderSeen || g.first < g.airtime ? g.first : g.first - g.airtime;
+    Transmission tx = { start, start + g.airtime, transmitter, g.caplen, g.len, g.type, g.data };
+    m_pending.push (tx);
+  }
+
+  void Analyze (const Transmission &tx)
+  {
+    if (m_transmissions++ == 0)
+      {
+        m_firstStart = tx.start;
+      }
+    m_typeCount[tx.type]++;
+    m_typeAirtime[tx.type] += tx.end - tx.start;
+    if (tx.start < m_lastEnd)
+      {
+        // On the air together with the transmission that ends last so far
+        m_overlapped++;
+        m_typeOverlapped[tx.type]++;
+        if (!m_holderOverlapped)
+          {
+            m_overlapped++;
+            m_typeOverlapped[m_holder.type]++;
+            m_holderOverlapped = true;
+          }
+        m_overlapTime += std::min (tx.end, m_lastEnd) - tx.start;
+        uint64_t a = std::min (m_holder.transmitter, tx.transmitter);
+        uint64_t b = std::max (m_holder.transmitter, tx.transmitter);
+        m_pairs[std::make_pair (a, b)]++;
+        if (tx.end > m_lastEnd)
+          {
+            m_busy += tx.end - m_lastEnd;
+            m_holder = tx;                 // still overlapped
+          }
+      }
+    else
+      {
+        m_busy += tx.end - tx.start;
+        m_holder = tx;
+        m_holderOverlapped = false;
+      }
+    m_lastEnd = std::max (m_lastEnd, tx.end);
+
+    if (m_out)
+      {
+        uint32_t header[4] = { static_cast<uint32_t> (tx.start / 1000000000), static_cast<uint32_t> (tx.start % 1000000000),
+                               tx.caplen, tx.len };
+        std::fwrite (header, sizeof (header), 1, m_out);
+        std::fwrite (tx.data, 1, tx.caplen, m_out);
+      }
+  }
+
+  Airtime m_airtime;
+  uint64_t m_slack;
+  std::vector<uint64_t> m_macs;          //!< own address of every capture, 0 until learnt
+  FILE *m_out;
+  uint64_t m_horizon;
+
+  std::deque<Group> m_open;              //!< by time of the first copy
+  uint64_t m_base = 0;                   //!< sequence number of m_open.front ()
+  std::unordered_map<uint64_t, uint64_t> m_index;   //!< frame hash to group sequence number
+  std::priority_queue<Transmission, std::vector<Transmission>, std::greater<Transmission> > m_pending;
+
+  uint64_t m_copies = 0;
+  uint64_t m_transmissions = 0;
+  uint64_t m_firstStart = 0;
+  uint64_t m_lastEnd = 0;
+  uint64_t m_busy = 0;
+  Transmission m_holder = Transmission ();
+  bool m_holderOverlapped = false;
+  uint64_t m_overlapped = 0;
+  uint64_t m_overlapTime = 0;
+  uint64_t m_typeCount[T_COUNT] = {};
+  uint64_t m_typeAirtime[T_COUNT] = {};
+  uint64_t m_typeOverlapped[T_COUNT] = {};
+  std::map<std::pair<uint64_t, uint64_t>, uint64_t> m_pairs;
+};
+
+/// Next record of one capture, ordered for a min-heap on time (then file, for a stable merge)
+struct Cursor
+{
+  uint64_t tsNs;
+  uint32_t file;
+
+  bool operator> (const Cursor &o) const
+  {
+    return tsNs != o.tsNs ? tsNs > o.tsNs : file > o.file;
+  }
+};
+
+void
+Usage (const char *name)
+{
+  std::cerr << "usage: " << name
+            << " [-d Mbps] [-c Mbps] [-a Mbps] [-s slack_us] [-n top] [-w merged.pcap] node.pcap [...]\n";
+}
+
+} // namespace
+
+int
+main (int argc, char **argv)
+{
+  Airtime airtime;
+  double slackUs = 10;
+  size_t top = 10;
+  std::string output;
+  int opt;
+  while ((opt = getopt (argc, argv, "d:c:a:s:n:w:")) != -1)
+    {
+      switch (opt)
+        {
+        case 'd': airtime.dataMbps = std::atof (optarg); break;
+        case 'c': airtime.controlMbps = std::atof (optarg); break;
+        case 'a': airtime.ackMbps = std::atof (optarg); break;
+        case 's': slackUs = std::atof (optarg); break;
+        case 'n': top = std::strtoul (optarg, 0, 10); break;
+        case 'w': output = optarg; break;
+        default:
+          Usage (argv[0]);
+          return 1;
+        }
+    }
+  if (optind >= argc || airtime.dataMbps <= 0 || airtime.controlMbps <= 0 || airtime.ackMbps <= 0)
+    {
+      Usage (argv[0]);
+      return 1;
+    }
+
+  FILE *out = 0;
+  try
+    {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+      std::vector<std::unique_ptr<pcap::PcapReader> > readers;
+      std::vector<pcap::Record> next (argc - optind);
+      std::priority_queue<Cursor, std::vector<Cursor>, std::greater<Cursor> > heap;
+      for (int i = optind; i < argc; ++i)
+        {
+          readers.emplace_back (new pcap::PcapReader (argv[i]));
+          if (readers.back ()->LinkType () != pcap::LINKTYPE_IEEE802_11)
+            {
+              std::ostringstream msg;
+              msg << argv[i] << ": link type " << readers.back ()->LinkType () << ", expected 802.11 (105)";
+              throw std::runtime_error (msg.str ());
+            }
+          uint32_t file = static_cast<uint32_t> (readers.size () - 1);
+          if (readers.back ()->Next (next[file]))
+            {
+              heap.push (Cursor { next[file].tsNs, file });
+            }
+        }
+      if (!output.empty ())
+        {
+          out = std::fopen (output.c_str (), "wb");
+          if (!out)
+            {
+              throw std::runtime_error ("cannot create " + output);
+            }
+          std::setvbuf (out, 0, _IOFBF, 1 << 20);
+        }
+
+      ChannelMerger merger (airtime, static_cast<uint64_t> (slackUs * 1000), readers.size (), out);
+      while (!heap.empty ())
+        {
+          uint32_t file = heap.top ().file;
+          heap.pop ();
+          merger.Add (file, next[file]);
+          if (readers[file]->Next (next[file]))
+            {
+              heap.push (Cursor { next[file].tsNs, file });
+            }
+        }
+      merger.Finish ();
+      if (out)
+        {
+          std::fclose (out);
+          out = 0;
+        }
+      double elapsed = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+
+      std::cout << readers.size () << " captures in " << elapsed << " s\n";
+      merger.Report (std::cout, top);
+    }
+  catch (const std::exception &e)
+    {
+      if (out)
+        {
+          std::fclose (out);
+        }
+      std::cerr << "error: " << e.what () << "\n";
+      return 1;
+    }
+  return 0;
+}